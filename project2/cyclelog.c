@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simulate.h"
+#include "cyclelog.h"
+
+/*
+ * Compact per-cycle log of the 5-stage pipeline (-l), the cheap
+ * alternative to printState for long runs.  A record holds the five
+ * latches and the register and memory writes of the previous cycle, about
+ * 40 bytes instead of a full dump of memory and registers; pipeview turns
+ * the log into a pipeline diagram.
+ */
+
+#define LOGBUFSIZE     (1 << 16)
+#define MAXLOGWRITES   8
+/* cycle, flag, pc, five latches, then the counted register and memory writes */
+#define MAXLOGRECORD   (4 + 1 + 4 + 5 * 5 + 1 + MAXLOGWRITES * 5 + 1 + MAXLOGWRITES * 9)
+
+FILE            *cycleLog;
+
+static unsigned char buf[LOGBUFSIZE];
+static int           bufLen;
+
+static int       numRegWrites;
+static int       regWrite[MAXLOGWRITES][3];
+static int       numMemWrites;
+static int       memWrite[MAXLOGWRITES][3];
+
+static void      logByte(int);
+static void      logInt(int);
+static void      logLatch(int, int, int);
+static void      logFlush(void);
+
+void
+logOpen(const char *path)
+{
+  cycleLog = fopen(path, "wb");
+  if (cycleLog == NULL) {
+    printf("error: can't open file %s", path);
+    perror("fopen");
+    exit(1);
+  }
+  memcpy(buf, CYCLELOG_MAGIC, 4);
+  bufLen = 4;
+  logInt(CYCLELOG_VERSION);
+  logInt(numThreads);
+}
+
+/*
+ * Appends the record for the state before the cycle statePtr is about to
+ * run; advanced tells whether the previous call moved the stages.
+ */
+void
+logCycle(stateType *statePtr, int advanced)
+{
+  int i;
+
+  if (bufLen > LOGBUFSIZE - MAXLOGRECORD)
+    logFlush();
+
+  logInt(statePtr->cycles);
+  logByte(advanced ? LOG_ADVANCED : 0);
+  logInt(statePtr->IFID.pcPlus1 - 1);
+  logLatch(statePtr->IFID.instr, statePtr->IFID.valid, statePtr->IFID.tid);
+  logLatch(statePtr->IDEX.instr, statePtr->IDEX.valid, statePtr->IDEX.tid);
+  logLatch(statePtr->EXMEM.instr, statePtr->EXMEM.valid, statePtr->EXMEM.tid);
+  logLatch(statePtr->MEMWB.instr, statePtr->MEMWB.valid, statePtr->MEMWB.tid);
+  /* WBEND has no valid bit; its instruction has already retired */
+  logLatch(statePtr->WBEND.instr, 0, statePtr->WBEND.tid);
+
+  logByte(numRegWrites);
+  for (i = 0; i < numRegWrites; i++) {
+    logByte(regWrite[i][0] << 3 | regWrite[i][1]);
+    logInt(regWrite[i][2]);
+  }
+  logByte(numMemWrites);
+  for (i = 0; i < numMemWrites; i++) {
+    logByte(memWrite[i][0]);
+    logInt(memWrite[i][1]);
+    logInt(memWrite[i][2]);
+  }
+  numRegWrites = numMemWrites = 0;
+}
+
+void
+logRegWrite(int tid, int reg, int value)
+{
+  if (numRegWrites == MAXLOGWRITES)
+    return;
+  regWrite[numRegWrites][0] = tid;
+  regWrite[numRegWrites][1] = reg;
+  regWrite[numRegWrites][2] = value;
+  numRegWrites++;
+}
+
+void
+logMemWrite(int tid, int addr, int value)
+{
+  if (numMemWrites == MAXLOGWRITES)
+    return;
+  memWrite[numMemWrites][0] = tid;
+  memWrite[numMemWrites][1] = addr;
+  memWrite[numMemWrites][2] = value;
+  numMemWrites++;
+}
+
+void
+logClose(void)
+{
+  logFlush();
+  fclose(cycleLog);
+  cycleLog = NULL;
+}
+
+static void
+logByte(int b)
+{
+  buf[bufLen++] = b & 0xff;
+}
+
+static void
+logInt(int v)
+{
+  unsigned u = v;
+
+  buf[bufLen++] = u & 0xff;
+  buf[bufLen++] = (u >> 8) & 0xff;
+  buf[bufLen++] = (u >> 16) & 0xff;
+  buf[bufLen++] = (u >> 24) & 0xff;
+}
+
+static void
+logLatch(int instr, int valid, int tid)
+{
+  logInt(instr);
+  logByte((valid ? 1 : 0) | tid << 1);
+}
+
+static void
+logFlush(void)
+{
+  if (bufLen && fwrite(buf, 1, bufLen, cycleLog) != (size_t)bufLen) {
+    perror("fwrite");
+    exit(1);
+  }
+  bufLen = 0;
+}
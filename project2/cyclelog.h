@@ -0,0 +1,34 @@
+#ifndef CYCLELOG_H
+#define CYCLELOG_H
+
+/*
+ * Binary cycle log written by `simulate -l` and read by pipeview.
+ *
+ * All integers are little-endian.  The file starts with a header
+ *
+ *   char[4]  CYCLELOG_MAGIC
+ *   int32    CYCLELOG_VERSION
+ *   int32    number of hardware threads
+ *
+ * followed by one record per call of the cycle loop, describing the state
+ * before that cycle starts:
+ *
+ *   int32    cycle
+ *   uint8    flags (LOG_ADVANCED)
+ *   int32    IFID pc
+ *   5 x {int32 instr, uint8 valid | tid << 1}   IFID, IDEX, EXMEM, MEMWB, WBEND
+ *   uint8    number of register writes, each {uint8 tid << 3 | reg, int32 value}
+ *   uint8    number of memory writes, each {uint8 tid, int32 addr, int32 value}
+ *
+ * LOG_ADVANCED is set when the stages moved since the previous record;
+ * when it is clear, the cycles in between were a data-cache stall.  Only
+ * register and memory writes that change a value are recorded.
+ */
+
+#define CYCLELOG_MAGIC    "LCYC"
+#define CYCLELOG_VERSION  1
+
+#define LOG_ADVANCED      0x1
+#define LOG_NUMLATCHES    5
+
+#endif
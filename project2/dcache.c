@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simulate.h"
+
+/*
+ * Direct-mapped, write-allocate data cache shared by both timing models.
+ * Only tags are kept; data always lives in dataMem.  With
+ * dcacheMissLatency == 0 the cache is disabled and every access takes the
+ * single MEM cycle of the original pipeline.
+ */
+
+#define DCACHELINES   64
+#define DCACHEBLOCK   4     /* words per block */
+
+int              dcacheMissLatency;
+long long        dcacheHits;
+long long        dcacheMisses;
+
+static int       tag[DCACHELINES];
+static char      valid[DCACHELINES];
+
+static int       dcacheLookup(int);
+
+/*
+ * Returns the extra cycles an access to addr costs: 0 on a hit, the miss
+ * latency on a miss.
+ */
+int
+dcacheAccess(int addr)
+{
+  if (!dcacheMissLatency)
+    return 0;
+  if (dcacheLookup(addr)) {
+    dcacheHits++;
+    return 0;
+  }
+  dcacheMisses++;
+  return dcacheMissLatency;
+}
+
+/*
+ * Updates the tags for addr without timing or statistics; used by the
+ * functional warming phase of sampled simulation.
+ */
+void
+dcacheWarm(int addr)
+{
+  if (dcacheMissLatency)
+    dcacheLookup(addr);
+}
+
+void
+dcacheReport(void)
+{
+  if (!dcacheMissLatency)
+    return;
+  printf("data cache: %d lines of %d words, miss latency %d\n",
+         DCACHELINES, DCACHEBLOCK, dcacheMissLatency);
+  printf("\thits %lld, misses %lld\n", dcacheHits, dcacheMisses);
+}
+
+static int
+dcacheLookup(int addr)
+{
+  int block, line;
+
+  block = (unsigned)addr / DCACHEBLOCK;
+  line = block % DCACHELINES;
+  if (valid[line] && tag[line] == block)
+    return 1;
+  valid[line] = 1;
+  tag[line] = block;
+  return 0;
+}
@@ -0,0 +1,735 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simulate.h"
+
+/*
+ * Out-of-order timing model for LC-2K.
+ *
+ * Instructions are fetched in order (beq predicted by a bimodal table,
+ * jalr predicted fall-through), renamed through the register alias table
+ * onto reorder buffer entries, and wait in reservation stations (ALU ops)
+ * or the load/store queue (lw, sw) until their operands arrive on the
+ * common data bus.  Results commit in order from the ROB head, stores
+ * write dataMem only at commit and mispredicted branches flush the whole
+ * window at commit, so the architectural state is always precise and
+ * `halt` stops the machine exactly at its ROB head.
+ */
+
+#define ROBSIZE       32
+#define RSSIZE        16
+#define LSQSIZE       16
+#define WIDTH         2     /* fetch, issue and commit width */
+#define ALULATENCY    1
+#define LOADLATENCY   2
+#define FWDLATENCY    1
+#define BHTSIZE       256
+
+typedef struct robStruct {
+  int busy;
+  int instr;
+  int pc;
+  int dest;         /* architectural register written, -1 if none */
+  int value;
+  int done;
+  int lsq;          /* LSQ slot of a lw/sw, -1 otherwise */
+  int predPc;       /* pc fetched after this instruction */
+  int nextPc;       /* pc resolved at execute */
+} robType;
+
+typedef struct rsStruct {
+  int busy;
+  int rob;
+  int op;
+  int vj, vk;
+  int qj, qk;       /* producing ROB entry, -1 once the value is present */
+  int offset;
+  int pc;
+  int finish;       /* cycle the result is broadcast, -1 until issued */
+} rsType;
+
+typedef struct lsqStruct {
+  int busy;
+  int store;
+  int rob;
+  int base, qbase;
+  int data, qdata;
+  int offset;
+  int addrReady;
+  int addr;
+  int finish;       /* load completion cycle, -1 until issued */
+  int missed;       /* the load missed in the data cache */
+} lsqType;
+
+typedef struct oooStruct {
+  robType       rob[ROBSIZE];
+  int           robHead, robTail, robCount;
+  rsType        rs[RSSIZE];
+  int           rsCount;
+  lsqType       lsq[LSQSIZE];
+  int           lsqHead, lsqTail, lsqCount;
+  int           rat[NUMREGS];
+  unsigned char bht[BHTSIZE];
+  int           fetchPc;
+  int           fetchStopped;
+  int           draining;
+  int           halted;
+  int           cycles;
+  int           active;       /* anything changed this cycle */
+  int           commits;      /* instructions committed this cycle */
+  int           stallCause;   /* STALL_* charged for a cycle without commit */
+  long long    *stallCtr;     /* dispatch stall counted this cycle */
+
+  long long     committed;
+  long long     branches;
+  long long     mispredicts;
+  long long     squashed;
+  long long     loads;
+  long long     forwarded;
+  long long     robFull;
+  long long     rsFull;
+  long long     lsqFull;
+  long long     robHist[ROBSIZE + 1];
+  long long     rsHist[RSSIZE + 1];
+  long long     lsqHist[LSQSIZE + 1];
+} oooType;
+
+static oooType    core;
+static stateType *arch;
+
+static const char *unitName[3] = { "rob", "rs", "lsq" };
+
+static void       oooCommit(void);
+static void       oooWriteback(void);
+static void       oooIssue(void);
+static void       oooMemory(void);
+static void       oooDispatch(void);
+static void       oooFlush(void);
+static void       oooBroadcast(int, int);
+static void       oooReadOperand(int, int*, int*);
+static int        oooAge(int);
+static void       oooSkip(void);
+static int        oooStallCause(void);
+static void       oooPrintHist(const char*, long long*, int);
+
+void
+oooRun(stateType *statePtr)
+{
+  oooInit(statePtr);
+  while (!oooCycle())
+    ;
+  arch->cycles = core.cycles;
+
+  printf("machine halted\n");
+  printf("total of %d cycles executed\n", core.cycles);
+  oooReport();
+  dcacheReport();
+  printArchState(arch);
+}
+
+void
+oooInit(stateType *statePtr)
+{
+  int i;
+
+  arch = statePtr;
+  memset(&core, 0, sizeof(oooType));
+  for (i = 0; i < NUMREGS; i++)
+    core.rat[i] = -1;
+  memset(core.bht, 1, sizeof(core.bht));
+  core.fetchPc = arch->pc;
+  perfInit("out-of-order", 3, unitName);
+}
+
+/*
+ * Advances the core by one cycle; returns 1 once halt has committed.
+ */
+int
+oooCycle(void)
+{
+  core.active = 0;
+  core.commits = 0;
+  core.stallCtr = NULL;
+  core.robHist[core.robCount]++;
+  core.rsHist[core.rsCount]++;
+  core.lsqHist[core.lsqCount]++;
+  perf.cycles++;
+  perf.unitBusy[0] += core.robCount;
+  perf.unitBusy[1] += core.rsCount;
+  perf.unitBusy[2] += core.lsqCount;
+
+  oooCommit();
+  if (core.halted) {
+    core.cycles++;
+    arch->pc = core.fetchPc;
+    return 1;
+  }
+  if (!core.commits) {
+    core.stallCause = oooStallCause();
+    perf.stalls[core.stallCause]++;
+  }
+  oooWriteback();
+  oooIssue();
+  oooMemory();
+  if (!core.draining)
+    oooDispatch();
+  core.cycles++;
+  if (!core.active && cycleSkip)
+    oooSkip();
+  PERFSAMPLE();
+  return 0;
+}
+
+/*
+ * Attributes a cycle in which nothing committed to what the ROB head is
+ * waiting for.  Structural stalls are counted separately, at dispatch.
+ */
+static int
+oooStallCause(void)
+{
+  robType *e;
+  lsqType *m;
+  int      i, q;
+
+  if (core.robCount == 0)
+    return STALL_CONTROL;
+  e = &core.rob[core.robHead];
+  if (e->lsq >= 0) {
+    m = &core.lsq[e->lsq];
+    return (m->finish >= 0 && m->missed) ? STALL_MEMORY : STALL_DATA;
+  }
+  for (i = 0; i < RSSIZE; i++) {
+    if (!core.rs[i].busy || core.rs[i].rob != core.robHead)
+      continue;
+    q = core.rs[i].qj >= 0 ? core.rs[i].qj : core.rs[i].qk;
+    if (q >= 0 && opcode(core.rob[q].instr) == LW)
+      return STALL_LOADUSE;
+    break;
+  }
+  return STALL_DATA;
+}
+
+/*
+ * Called after a cycle in which nothing changed.  Until the next pending
+ * completion nothing can change either, so jump straight to it while
+ * charging the skipped cycles to the occupancy histograms and to the
+ * dispatch stall that held the front end.
+ */
+static void
+oooSkip(void)
+{
+  int i, next, skip;
+
+  next = -1;
+  for (i = 0; i < RSSIZE; i++) {
+    if (core.rs[i].busy && core.rs[i].finish >= 0
+        && (next < 0 || core.rs[i].finish < next))
+      next = core.rs[i].finish;
+  }
+  for (i = 0; i < LSQSIZE; i++) {
+    if (core.lsq[i].busy && !core.lsq[i].store && core.lsq[i].finish >= 0
+        && !core.rob[core.lsq[i].rob].done
+        && (next < 0 || core.lsq[i].finish < next))
+      next = core.lsq[i].finish;
+  }
+  if (next <= core.cycles)
+    return;
+
+  skip = next - core.cycles;
+  core.robHist[core.robCount] += skip;
+  core.rsHist[core.rsCount] += skip;
+  core.lsqHist[core.lsqCount] += skip;
+  perf.cycles += skip;
+  perf.unitBusy[0] += (long long)skip * core.robCount;
+  perf.unitBusy[1] += (long long)skip * core.rsCount;
+  perf.unitBusy[2] += (long long)skip * core.lsqCount;
+  perf.stalls[core.stallCause] += skip;
+  if (core.stallCtr) {
+    *core.stallCtr += skip;
+    perf.stalls[STALL_STRUCTURAL] += skip;
+  }
+  core.cycles = next;
+}
+
+/*
+ * Stops dispatch and runs until every instruction in flight has committed,
+ * leaving arch->pc at the next instruction to execute.
+ */
+void
+oooDrain(void)
+{
+  core.draining = 1;
+  while (core.robCount > 0 && !core.halted)
+    oooCycle();
+  arch->pc = core.fetchPc;
+}
+
+/*
+ * Restarts fetch at arch->pc after the architectural state was advanced
+ * elsewhere.  Predictor state is kept.
+ */
+void
+oooResume(void)
+{
+  core.draining = 0;
+  core.fetchStopped = 0;
+  core.fetchPc = arch->pc;
+}
+
+void
+oooWarmBranch(int pc, int taken)
+{
+  unsigned char *ctr = &core.bht[pc % BHTSIZE];
+
+  if (taken) {
+    if (*ctr < 3) (*ctr)++;
+  } else if (*ctr > 0) {
+    (*ctr)--;
+  }
+}
+
+long long
+oooCommitted(void)
+{
+  return core.committed;
+}
+
+int
+oooCycles(void)
+{
+  return core.cycles;
+}
+
+void
+oooReport(void)
+{
+  printf("out-of-order core: rob %d, rs %d, lsq %d, width %d\n",
+         ROBSIZE, RSSIZE, LSQSIZE, WIDTH);
+  printf("\tinstructions committed %lld\n", core.committed);
+  printf("\tIPC %.3f\n", (double)core.committed / core.cycles);
+  printf("\tbeq/jalr %lld, mispredicted %lld, squashed instructions %lld\n",
+         core.branches, core.mispredicts, core.squashed);
+  printf("\tloads %lld, forwarded from store queue %lld\n",
+         core.loads, core.forwarded);
+  printf("\tdispatch stalls: rob full %lld, rs full %lld, lsq full %lld\n",
+         core.robFull, core.rsFull, core.lsqFull);
+  oooPrintHist("ROB", core.robHist, ROBSIZE);
+  oooPrintHist("RS", core.rsHist, RSSIZE);
+  oooPrintHist("LSQ", core.lsqHist, LSQSIZE);
+}
+
+static void
+oooCommit(void)
+{
+  robType *e;
+  lsqType *m;
+  int      n, op;
+
+  for (n = 0; n < WIDTH && core.robCount > 0; n++) {
+    e = &core.rob[core.robHead];
+    if (!e->done)
+      return;
+    op = opcode(e->instr);
+    core.committed++;
+    core.commits++;
+    core.active = 1;
+    perf.retired++;
+    if (op >= 0 && op < 8)
+      perf.opcodes[op]++;
+    if (op == HALT) {
+      core.halted = 1;
+      return;
+    }
+
+    if (e->dest >= 0) {
+      arch->reg[e->dest] = e->value;
+      if (core.rat[e->dest] == core.robHead)
+        core.rat[e->dest] = -1;
+    }
+    if (e->lsq >= 0) {
+      m = &core.lsq[e->lsq];
+      if (m->store) {
+        if (m->addr < 0 || m->addr >= NUMMEMORY) {
+          printf("error: store to address %d out of memory\n", m->addr);
+          exit(1);
+        }
+        arch->dataMem[m->addr] = m->data;
+        dcacheAccess(m->addr);
+      }
+      m->busy = 0;
+      core.lsqHead = (core.lsqHead + 1) % LSQSIZE;
+      core.lsqCount--;
+    }
+
+    e->busy = 0;
+    core.robHead = (core.robHead + 1) % ROBSIZE;
+    core.robCount--;
+
+    if (op == JALR) {
+      core.branches++;
+      perf.jalr++;
+    }
+    if (op == BEQ) {
+      core.branches++;
+      perf.beq++;
+      if (e->nextPc != e->pc + 1)
+        perf.taken++;
+      oooWarmBranch(e->pc, e->nextPc != e->pc + 1);
+    }
+    if ((op == BEQ || op == JALR) && e->nextPc != e->predPc) {
+      core.mispredicts++;
+      perf.mispredicted++;
+      oooFlush();
+      core.fetchPc = e->nextPc;
+      return;
+    }
+  }
+}
+
+static void
+oooWriteback(void)
+{
+  rsType  *r;
+  lsqType *m;
+  robType *e;
+  int      i, value;
+
+  for (i = 0; i < RSSIZE; i++) {
+    r = &core.rs[i];
+    if (!r->busy || r->finish < 0 || r->finish > core.cycles)
+      continue;
+    e = &core.rob[r->rob];
+    value = 0;
+    switch (r->op) {
+      case ADD:
+        value = ADD_OP(r->vj, r->vk);
+        break;
+      case NOR:
+        value = NOR_OP(r->vj, r->vk);
+        break;
+      case BEQ:
+        e->nextPc = BEQ_OP(r->vj, r->vk) == 0 ? r->pc + 1 + r->offset
+                                              : r->pc + 1;
+        break;
+      case JALR:
+        /* regA == regB jumps to pc+1, as regB is written first */
+        value = r->pc + 1;
+        e->nextPc = (field0(e->instr) == field1(e->instr)) ? r->pc + 1 : r->vj;
+        break;
+    }
+    e->value = value;
+    e->done = 1;
+    core.active = 1;
+    r->busy = 0;
+    core.rsCount--;
+    if (e->dest >= 0)
+      oooBroadcast(r->rob, value);
+  }
+
+  for (i = 0; i < LSQSIZE; i++) {
+    m = &core.lsq[i];
+    if (!m->busy || m->store || m->finish < 0 || m->finish > core.cycles)
+      continue;
+    e = &core.rob[m->rob];
+    if (e->done)
+      continue;
+    e->value = m->data;
+    e->done = 1;
+    core.active = 1;
+    oooBroadcast(m->rob, m->data);
+  }
+}
+
+static void
+oooIssue(void)
+{
+  rsType *r;
+  int     n, i, best, bestAge, age;
+
+  for (n = 0; n < WIDTH; n++) {
+    best = -1;
+    bestAge = ROBSIZE;
+    for (i = 0; i < RSSIZE; i++) {
+      r = &core.rs[i];
+      if (!r->busy || r->finish >= 0 || r->qj >= 0 || r->qk >= 0)
+        continue;
+      age = oooAge(r->rob);
+      if (age < bestAge) {
+        best = i;
+        bestAge = age;
+      }
+    }
+    if (best < 0)
+      return;
+    core.rs[best].finish = core.cycles + ALULATENCY;
+    core.active = 1;
+  }
+}
+
+/*
+ * Generates addresses, marks stores ready to commit and issues at most one
+ * load per cycle.  A load waits while any older store has an unknown
+ * address, and takes its value from the youngest older store to the same
+ * address when there is one.
+ */
+static void
+oooMemory(void)
+{
+  lsqType *m, *o;
+  int      n, i, j, blocked, fwd, loadIssued;
+
+  loadIssued = 0;
+  for (n = 0, i = core.lsqHead; n < core.lsqCount; n++, i = (i + 1) % LSQSIZE) {
+    m = &core.lsq[i];
+    if (!m->addrReady && m->qbase < 0) {
+      m->addr = m->base + m->offset;
+      m->addrReady = 1;
+      core.active = 1;
+    }
+    if (m->store) {
+      if (m->addrReady && m->qdata < 0 && !core.rob[m->rob].done) {
+        core.rob[m->rob].done = 1;
+        core.active = 1;
+      }
+      continue;
+    }
+    if (!m->addrReady || m->finish >= 0 || loadIssued)
+      continue;
+
+    blocked = 0;
+    fwd = -1;
+    for (j = i; j != core.lsqHead; ) {
+      j = (j + LSQSIZE - 1) % LSQSIZE;
+      o = &core.lsq[j];
+      if (!o->store)
+        continue;
+      if (!o->addrReady) {
+        blocked = 1;
+        break;
+      }
+      if (o->addr == m->addr) {
+        if (o->qdata >= 0)
+          blocked = 1;
+        else
+          fwd = j;
+        break;
+      }
+    }
+    if (blocked)
+      continue;
+
+    loadIssued = 1;
+    core.active = 1;
+    core.loads++;
+    if (fwd >= 0) {
+      core.forwarded++;
+      m->data = core.lsq[fwd].data;
+      m->finish = core.cycles + FWDLATENCY;
+    } else {
+      /* only a wrong-path load can stray outside memory */
+      m->data = (m->addr >= 0 && m->addr < NUMMEMORY)
+                ? arch->dataMem[m->addr] : 0;
+      m->finish = core.cycles + LOADLATENCY;
+      if (m->addr >= 0 && m->addr < NUMMEMORY) {
+        m->missed = dcacheAccess(m->addr) > 0;
+        m->finish += m->missed ? dcacheMissLatency : 0;
+      }
+    }
+  }
+}
+
+static void
+oooDispatch(void)
+{
+  robType *e;
+  rsType  *r;
+  lsqType *m;
+  int      n, i, instr, op, pc, idx, offset;
+
+  for (n = 0; n < WIDTH; n++) {
+    pc = core.fetchPc;
+    if (core.fetchStopped || pc < 0 || pc >= NUMMEMORY)
+      return;
+    instr = arch->instrMem[pc];
+    op = opcode(instr);
+
+    if (core.robCount == ROBSIZE) {
+      core.robFull++;
+      core.stallCtr = &core.robFull;
+      perf.stalls[STALL_STRUCTURAL]++;
+      return;
+    }
+    if ((op == LW || op == SW) && core.lsqCount == LSQSIZE) {
+      core.lsqFull++;
+      core.stallCtr = &core.lsqFull;
+      perf.stalls[STALL_STRUCTURAL]++;
+      return;
+    }
+    if ((op == ADD || op == NOR || op == BEQ || op == JALR)
+        && core.rsCount == RSSIZE) {
+      core.rsFull++;
+      core.stallCtr = &core.rsFull;
+      perf.stalls[STALL_STRUCTURAL]++;
+      return;
+    }
+
+    idx = core.robTail;
+    e = &core.rob[idx];
+    memset(e, 0, sizeof(robType));
+    e->busy = 1;
+    e->instr = instr;
+    e->pc = pc;
+    e->dest = -1;
+    e->lsq = -1;
+    e->predPc = pc + 1;
+    offset = CONVERT_TO_32(field2(instr));
+
+    switch (op) {
+      case ADD:
+      case NOR:
+      case BEQ:
+      case JALR:
+        for (i = 0; core.rs[i].busy; i++)
+          ;
+        r = &core.rs[i];
+        r->busy = 1;
+        r->rob = idx;
+        r->op = op;
+        r->pc = pc;
+        r->offset = offset;
+        r->finish = -1;
+        oooReadOperand(field0(instr), &r->vj, &r->qj);
+        oooReadOperand(field1(instr), &r->vk, &r->qk);
+        core.rsCount++;
+        if (op == ADD || op == NOR)
+          e->dest = field2(instr) & 0x7;
+        else if (op == JALR)
+          e->dest = field1(instr);
+        else if (core.bht[pc % BHTSIZE] >= 2)
+          e->predPc = pc + 1 + offset;
+        break;
+      case LW:
+      case SW:
+        m = &core.lsq[core.lsqTail];
+        memset(m, 0, sizeof(lsqType));
+        m->busy = 1;
+        m->store = (op == SW);
+        m->rob = idx;
+        m->offset = offset;
+        m->finish = -1;
+        m->qdata = -1;
+        oooReadOperand(field0(instr), &m->base, &m->qbase);
+        if (m->store)
+          oooReadOperand(field1(instr), &m->data, &m->qdata);
+        else
+          e->dest = field1(instr);
+        e->lsq = core.lsqTail;
+        core.lsqTail = (core.lsqTail + 1) % LSQSIZE;
+        core.lsqCount++;
+        break;
+      case HALT:
+        e->done = 1;
+        core.fetchStopped = 1;
+        break;
+      default:
+        /* noop, or a data word fetched down a wrong path */
+        e->done = 1;
+        break;
+    }
+
+    if (e->dest >= 0)
+      core.rat[e->dest] = idx;
+    core.robTail = (core.robTail + 1) % ROBSIZE;
+    core.robCount++;
+    core.active = 1;
+    core.fetchPc = e->predPc;
+  }
+}
+
+static void
+oooFlush(void)
+{
+  int i;
+
+  core.squashed += core.robCount;
+  for (i = 0; i < ROBSIZE; i++)
+    core.rob[i].busy = 0;
+  for (i = 0; i < RSSIZE; i++)
+    core.rs[i].busy = 0;
+  for (i = 0; i < LSQSIZE; i++)
+    core.lsq[i].busy = 0;
+  for (i = 0; i < NUMREGS; i++)
+    core.rat[i] = -1;
+  core.robTail = core.robHead;
+  core.lsqTail = core.lsqHead;
+  core.robCount = core.rsCount = core.lsqCount = 0;
+  core.fetchStopped = 0;
+}
+
+static void
+oooBroadcast(int rob, int value)
+{
+  int i;
+
+  for (i = 0; i < RSSIZE; i++) {
+    if (!core.rs[i].busy)
+      continue;
+    if (core.rs[i].qj == rob) {
+      core.rs[i].vj = value;
+      core.rs[i].qj = -1;
+    }
+    if (core.rs[i].qk == rob) {
+      core.rs[i].vk = value;
+      core.rs[i].qk = -1;
+    }
+  }
+  for (i = 0; i < LSQSIZE; i++) {
+    if (!core.lsq[i].busy)
+      continue;
+    if (core.lsq[i].qbase == rob) {
+      core.lsq[i].base = value;
+      core.lsq[i].qbase = -1;
+    }
+    if (core.lsq[i].qdata == rob) {
+      core.lsq[i].data = value;
+      core.lsq[i].qdata = -1;
+    }
+  }
+}
+
+static void
+oooReadOperand(int reg, int *value, int *tag)
+{
+  int producer = core.rat[reg];
+
+  if (producer < 0) {
+    *value = arch->reg[reg];
+    *tag = -1;
+  } else if (core.rob[producer].done) {
+    *value = core.rob[producer].value;
+    *tag = -1;
+  } else {
+    *value = 0;
+    *tag = producer;
+  }
+}
+
+static int
+oooAge(int rob)
+{
+  return (rob - core.robHead + ROBSIZE) % ROBSIZE;
+}
+
+static void
+oooPrintHist(const char *name, long long *hist, int size)
+{
+  int i;
+
+  printf("\t%s occupancy:\n", name);
+  for (i = 0; i <= size; i++) {
+    if (hist[i])
+      printf("\t\t%2d entries %8lld cycles (%5.1f%%)\n", i, hist[i],
+             100.0 * hist[i] / core.cycles);
+  }
+}
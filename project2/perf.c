@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simulate.h"
+
+/*
+ * Performance counters shared by the timing models.  The engines bump the
+ * fields of `perf` directly; the only per-cycle cost beyond that is the
+ * PERFSAMPLE() check, which is a single branch while interval sampling
+ * (-i) is off.
+ */
+
+typedef struct perfSampleStruct {
+  long long cycles;
+  long long retired;
+  long long stalls[NUMSTALLS];
+} perfSampleType;
+
+perfType         perf;
+int              perfInterval;
+long long        perfNextSample;
+
+static perfSampleType *samples;
+static int             numSamples;
+static int             maxSamples;
+
+static const char *stallName[NUMSTALLS] = {
+  "data", "load_use", "control", "structural", "memory"
+};
+
+static const char *opName[8] = {
+  "add", "nor", "lw", "sw", "beq", "jalr", "halt", "noop"
+};
+
+/*
+ * Names the occupancy counters of the engine in use; unitBusy[i] then
+ * accumulates the number of instructions (or entries) held by unit i per
+ * cycle.
+ */
+void
+perfInit(const char *engine, int numUnits, const char **unitNames)
+{
+  int i;
+
+  memset(&perf, 0, sizeof(perfType));
+  perf.engine = engine;
+  perf.numUnits = numUnits;
+  for (i = 0; i < numUnits; i++)
+    perf.unitName[i] = unitNames[i];
+  perfNextSample = perfInterval;
+}
+
+void
+perfSample(void)
+{
+  perfSampleType *s;
+
+  if (numSamples == maxSamples) {
+    maxSamples = maxSamples ? 2 * maxSamples : 256;
+    samples = realloc(samples, sizeof(perfSampleType) * maxSamples);
+    if (!samples) {
+      printf("error: out of memory for interval samples\n");
+      exit(1);
+    }
+  }
+  s = &samples[numSamples++];
+  s->cycles = perf.cycles;
+  s->retired = perf.retired;
+  memcpy(s->stalls, perf.stalls, sizeof(s->stalls));
+  while (perfNextSample <= perf.cycles)
+    perfNextSample += perfInterval;
+}
+
+void
+perfWriteJson(const char *path)
+{
+  FILE *fp;
+  int   i, j;
+
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    printf("error: can't open file %s", path);
+    perror("fopen");
+    exit(1);
+  }
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"engine\": \"%s\",\n", perf.engine);
+  fprintf(fp, "  \"cycles\": %lld,\n", perf.cycles);
+  fprintf(fp, "  \"retired\": %lld,\n", perf.retired);
+  fprintf(fp, "  \"cpi\": %.6f,\n",
+          perf.retired ? (double)perf.cycles / perf.retired : 0.0);
+
+  fprintf(fp, "  \"stall_cycles\": {");
+  for (i = 0; i < NUMSTALLS; i++)
+    fprintf(fp, "%s\"%s\": %lld", i ? ", " : "", stallName[i], perf.stalls[i]);
+  fprintf(fp, "},\n");
+  fprintf(fp, "  \"unresolved_hazards\": {\"data\": %lld, \"load_use\": %lld},\n",
+          perf.hazards[STALL_DATA], perf.hazards[STALL_LOADUSE]);
+
+  fprintf(fp, "  \"occupancy\": {");
+  for (i = 0; i < perf.numUnits; i++)
+    fprintf(fp, "%s\"%s\": %.4f", i ? ", " : "", perf.unitName[i],
+            perf.cycles ? (double)perf.unitBusy[i] / perf.cycles : 0.0);
+  fprintf(fp, "},\n");
+
+  fprintf(fp, "  \"branches\": {\"beq\": %lld, \"taken\": %lld, "
+          "\"mispredicted\": %lld, \"jalr\": %lld},\n",
+          perf.beq, perf.taken, perf.mispredicted, perf.jalr);
+
+  fprintf(fp, "  \"opcodes\": {");
+  for (i = 0; i < 8; i++)
+    fprintf(fp, "%s\"%s\": %lld", i ? ", " : "", opName[i], perf.opcodes[i]);
+  fprintf(fp, "},\n");
+
+  fprintf(fp, "  \"interval\": %d,\n", perfInterval);
+  fprintf(fp, "  \"samples\": [");
+  for (i = 0; i < numSamples; i++) {
+    fprintf(fp, "%s\n    {\"cycles\": %lld, \"retired\": %lld, \"stalls\": [",
+            i ? "," : "", samples[i].cycles, samples[i].retired);
+    for (j = 0; j < NUMSTALLS; j++)
+      fprintf(fp, "%s%lld", j ? ", " : "", samples[i].stalls[j]);
+    fprintf(fp, "]}");
+  }
+  fprintf(fp, "%s]\n}\n", numSamples ? "\n  " : "");
+  fclose(fp);
+}
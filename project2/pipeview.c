@@ -0,0 +1,328 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "simulate.h"
+#include "cyclelog.h"
+
+/*
+ * Renders the binary cycle log written by `simulate -l` as a pipeline
+ * diagram: one row per fetched instruction, one column per cycle.
+ *
+ *   IF ID EX ME WB   stage the instruction is in during that cycle
+ *   -                stalled in the same stage
+ *   x                squashed (multithreaded taken beq or miss replay)
+ *   lower case       wrong-path instruction after a taken beq
+ *
+ * Only the cycles in the window selected with -s/-n are kept in memory,
+ * so the log of a long run can be viewed a slice at a time.
+ */
+
+#define FIELD0(i)     (((i) >> 19) & 0x7)
+#define FIELD1(i)     (((i) >> 16) & 0x7)
+#define FIELD2(i)     ((i) & 0xFFFF)
+#define OPCODE(i)     ((i) >> 22)
+
+#define CELL_IF       1
+#define CELL_STALL    6
+#define CELL_SQUASH   7
+#define CELL_FLUSHED  0x8
+
+#define BUBBLE(l)     ((l).instr == NOOPINSTRUCTION && !(l).valid)
+
+typedef struct latchStruct {
+  int instr;
+  int valid;
+  int tid;
+} latchType;
+
+typedef struct instStruct {
+  int pc;
+  int instr;
+  int tid;
+  int flushed;
+  int lastCell;
+  int row;        /* -1 until it has a cell in the window */
+} instType;
+
+typedef struct rowStruct {
+  int            pc;
+  int            instr;
+  int            tid;
+  unsigned char *cells;
+} rowType;
+
+static const char *cellName[8] = {
+  "", "IF", "ID", "EX", "ME", "WB", "-", "x"
+};
+
+static const char *opName[8] = {
+  "add", "nor", "lw", "sw", "beq", "jalr", "halt", "noop"
+};
+
+static FILE     *logFile;
+static int       first, width, cellWidth, logThreads;
+static rowType  *rows;
+static int       numRows, maxRows;
+
+static int       getByte(void);
+static int       getInt(void);
+static void      setCell(instType*, int, int);
+static void      printRow(rowType*);
+static void      printWrite(int, int, const char*, int, int);
+static void      usage(char*);
+
+int
+main(int argc, char *argv[])
+{
+  instType   inst[4];
+  instType  *slot[4], *in;
+  latchType  latch[LOG_NUMLATCHES];
+  char       magic[4];
+  int        opt, writes, cycle, prev, flags, pc, records;
+  int        i, k, n, c, b, v, addr;
+
+  first = 0;
+  width = 60;
+  writes = 0;
+  while ((opt = getopt(argc, argv, "s:n:w")) != -1) {
+    switch (opt) {
+      case 's':
+        first = atoi(optarg);
+        break;
+      case 'n':
+        width = atoi(optarg);
+        break;
+      case 'w':
+        writes = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (argc - optind != 1 || width <= 0)
+    usage(argv[0]);
+
+  logFile = fopen(argv[optind], "rb");
+  if (logFile == NULL) {
+    printf("error: can't open file %s", argv[optind]);
+    perror("fopen");
+    exit(1);
+  }
+  if (fread(magic, 1, 4, logFile) != 4 || memcmp(magic, CYCLELOG_MAGIC, 4)
+      || getInt() != CYCLELOG_VERSION) {
+    printf("error: %s is not a cycle log\n", argv[optind]);
+    exit(1);
+  }
+  logThreads = getInt();
+
+  for (k = 0; k < 4; k++)
+    slot[k] = NULL;
+  prev = -1;
+  records = 0;
+  while ((c = getc(logFile)) != EOF) {
+    ungetc(c, logFile);
+    cycle = getInt();
+    flags = getByte();
+    pc = getInt();
+    for (k = 0; k < LOG_NUMLATCHES; k++) {
+      latch[k].instr = getInt();
+      b = getByte();
+      latch[k].valid = b & 1;
+      latch[k].tid = b >> 1;
+    }
+    records++;
+    if (cycle >= first + width)
+      break;
+
+    if (prev >= 0 && (flags & LOG_ADVANCED)) {
+      /* the stages moved during cycle - 1; MEMWB's instruction retired */
+      for (k = 3; k > 0; k--)
+        slot[k] = slot[k - 1];
+      slot[0] = NULL;
+      if (!BUBBLE(latch[0])) {
+        /* reuse the instType the retired instruction left behind */
+        in = NULL;
+        for (i = 0; i < 4 && in == NULL; i++) {
+          in = &inst[i];
+          for (k = 1; k < 4; k++) {
+            if (slot[k] == in)
+              in = NULL;
+          }
+        }
+        in->pc = pc;
+        in->instr = latch[0].instr;
+        in->tid = latch[0].tid;
+        in->flushed = !latch[0].valid;
+        in->lastCell = CELL_IF;
+        in->row = -1;
+        setCell(in, cycle - 1, CELL_IF);
+        slot[0] = in;
+      }
+      for (k = 1; k < 4; k++) {
+        if (slot[k] == NULL)
+          continue;
+        if (BUBBLE(latch[k])) {
+          setCell(slot[k], cycle, CELL_SQUASH);
+          slot[k] = NULL;
+        } else if (!latch[k].valid) {
+          slot[k]->flushed = 1;
+        }
+      }
+    } else if (prev >= 0) {
+      /* a data-cache stall skipped in one step */
+      for (c = prev + 1; c < cycle; c++) {
+        for (k = 0; k < 4; k++) {
+          if (slot[k])
+            setCell(slot[k], c, CELL_STALL);
+        }
+      }
+    }
+
+    for (k = 0; k < 4; k++) {
+      if (slot[k] == NULL)
+        continue;
+      setCell(slot[k], cycle, slot[k]->lastCell == k + 2 ? CELL_STALL : k + 2);
+      slot[k]->lastCell = k + 2;
+    }
+    prev = cycle;
+
+    /* writes listed in this record were made by WB/MEM in cycle - 1 */
+    n = getByte();
+    for (i = 0; i < n; i++) {
+      b = getByte();
+      v = getInt();
+      if (writes && cycle - 1 >= first)
+        printWrite(cycle - 1, b >> 3, "reg", b & 0x7, v);
+    }
+    n = getByte();
+    for (i = 0; i < n; i++) {
+      b = getByte();
+      addr = getInt();
+      v = getInt();
+      if (writes && cycle - 1 >= first)
+        printWrite(cycle - 1, b, "dataMem", addr, v);
+    }
+  }
+  fclose(logFile);
+
+  printf("%d records, cycles %d-%d\n", records, first, first + width - 1);
+  cellWidth = 4;
+  for (c = 1000; c <= first + width - 1; c *= 10)
+    cellWidth++;
+  printf("%*s", logThreads > 1 ? 29 : 26, "");
+  for (c = first; c < first + width; c++)
+    printf("%*d", cellWidth, c);
+  printf("\n");
+  for (i = 0; i < numRows; i++)
+    printRow(&rows[i]);
+  exit(0);
+}
+
+static int
+getByte(void)
+{
+  int b = getc(logFile);
+
+  if (b == EOF) {
+    printf("error: truncated cycle log\n");
+    exit(1);
+  }
+  return b;
+}
+
+static int
+getInt(void)
+{
+  unsigned u;
+
+  u = getByte();
+  u |= getByte() << 8;
+  u |= getByte() << 16;
+  u |= (unsigned)getByte() << 24;
+  return (int)u;
+}
+
+static void
+setCell(instType *in, int cycle, int cell)
+{
+  rowType *r;
+
+  if (cycle < first || cycle >= first + width)
+    return;
+  if (in->row < 0) {
+    if (numRows == maxRows) {
+      maxRows = maxRows ? 2 * maxRows : 64;
+      rows = realloc(rows, sizeof(rowType) * maxRows);
+      if (!rows) {
+        printf("error: out of memory for diagram rows\n");
+        exit(1);
+      }
+    }
+    r = &rows[numRows];
+    r->pc = in->pc;
+    r->instr = in->instr;
+    r->tid = in->tid;
+    r->cells = calloc(width, 1);
+    if (!r->cells) {
+      printf("error: out of memory for diagram rows\n");
+      exit(1);
+    }
+    in->row = numRows++;
+  }
+  rows[in->row].cells[cycle - first] = cell | (in->flushed ? CELL_FLUSHED : 0);
+}
+
+static void
+printRow(rowType *r)
+{
+  char text[32], name[4];
+  int  op, c, cell;
+
+  op = OPCODE(r->instr) & 0x7;
+  if (op == ADD || op == NOR)
+    sprintf(text, "%s %d %d %d", opName[op], FIELD0(r->instr),
+            FIELD1(r->instr), FIELD2(r->instr) & 0x7);
+  else if (op == LW || op == SW || op == BEQ)
+    sprintf(text, "%s %d %d %d", opName[op], FIELD0(r->instr),
+            FIELD1(r->instr), CONVERT_TO_32(FIELD2(r->instr)));
+  else if (op == JALR)
+    sprintf(text, "%s %d %d", opName[op], FIELD0(r->instr), FIELD1(r->instr));
+  else
+    sprintf(text, "%s", opName[op]);
+
+  if (logThreads > 1)
+    printf("t%d ", r->tid);
+  printf("%6d  %-18s", r->pc, text);
+  for (c = 0; c < width; c++) {
+    cell = r->cells[c];
+    strcpy(name, cellName[cell & 0x7]);
+    if (cell & CELL_FLUSHED) {
+      name[0] = name[0] >= 'A' && name[0] <= 'Z' ? name[0] - 'A' + 'a' : name[0];
+      name[1] = name[1] >= 'A' && name[1] <= 'Z' ? name[1] - 'A' + 'a' : name[1];
+    }
+    printf("%*s", cellWidth, name);
+  }
+  printf("\n");
+}
+
+static void
+printWrite(int cycle, int tid, const char *what, int index, int value)
+{
+  if (logThreads > 1)
+    printf("cycle %d: thread %d %s[ %d ] = %d\n", cycle, tid, what, index,
+           value);
+  else
+    printf("cycle %d: %s[ %d ] = %d\n", cycle, what, index, value);
+}
+
+static void
+usage(char *prog)
+{
+  printf("error: usage: %s [-s first] [-n cycles] [-w] <cycle log>\n", prog);
+  printf("\t-s first\tfirst cycle shown (default 0)\n");
+  printf("\t-n cycles\tnumber of cycles shown (default 60)\n");
+  printf("\t-w\t\tlist the register and memory writes in the window\n");
+  exit(1);
+}
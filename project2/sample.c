@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "simulate.h"
+
+/*
+ * Sampled simulation.
+ *
+ * The program runs on the functional engine and, once per sampling period,
+ * switches to a detailed model: the last `warming` functional instructions
+ * before a window train the data cache and the branch predictor, the
+ * detailed model then runs PIPEWARMUP instructions to fill its pipeline
+ * (cycles discarded) and a measured window of `window` instructions, and
+ * finally drains so that the functional engine resumes from precise
+ * architectural state.  Total cycles
+ * are extrapolated from the mean window CPI with a 95% confidence interval.
+ *
+ * The in-order pipeline has no interlocks, so it executes the same
+ * instruction stream as the functional engine only on hazard-free
+ * (noop-padded) code; its window CPI counts only correct-path instructions,
+ * so the three slots behind a taken beq show up as branch penalty.  The
+ * out-of-order engine has no such restriction.
+ */
+
+#define PIPEWARMUP    32
+#define Z95           1.96
+
+typedef struct sampleStatStruct {
+  int       windows;
+  double    mean;
+  double    m2;
+  long long functional;
+  long long detailed;
+} sampleStatType;
+
+static int  haltInFlight(stateType*);
+static int  sampleInOrder(stateType*, int, sampleStatType*);
+static int  sampleOutOfOrder(int, sampleStatType*);
+static void sampleAddWindow(sampleStatType*, double);
+
+/*
+ * Executes one instruction on the architectural state; returns 1 on halt.
+ */
+int
+funcStep(stateType *st)
+{
+  int instr, regA, regB, offset, addr;
+
+  if (st->pc < 0 || st->pc >= NUMMEMORY) {
+    printf("error: pc %d out of memory\n", st->pc);
+    exit(1);
+  }
+  instr  = st->instrMem[st->pc];
+  regA   = field0(instr);
+  regB   = field1(instr);
+  offset = CONVERT_TO_32(field2(instr));
+
+  switch (opcode(instr)) {
+    case ADD:
+      st->reg[field2(instr) & 0x7] = ADD_OP(st->reg[regA], st->reg[regB]);
+      break;
+    case NOR:
+      st->reg[field2(instr) & 0x7] = NOR_OP(st->reg[regA], st->reg[regB]);
+      break;
+    case LW:
+    case SW:
+      addr = MOV_OP(st->reg[regA], offset);
+      if (addr < 0 || addr >= NUMMEMORY) {
+        printf("error: address %d out of memory at pc %d\n", addr, st->pc);
+        exit(1);
+      }
+      if (opcode(instr) == LW)
+        st->reg[regB] = st->dataMem[addr];
+      else
+        st->dataMem[addr] = st->reg[regB];
+      break;
+    case BEQ:
+      if (BEQ_OP(st->reg[regA], st->reg[regB]) == 0)
+        st->pc += offset;
+      break;
+    case JALR:
+      /* regB is written first, so regA == regB jumps to pc+1 */
+      st->reg[regB] = st->pc + 1;
+      st->pc = st->reg[regA];
+      return 0;
+    case HALT:
+      st->pc++;
+      return 1;
+    case NOOP:
+      break;
+    default:
+      printf("error: unrecognized opcode at pc %d\n", st->pc);
+      exit(1);
+  }
+  st->pc++;
+  return 0;
+}
+
+void
+sampleRun(stateType *st, int outOfOrder, int period, int warming, int window)
+{
+  sampleStatType stat;
+  long long      fastForward, n;
+  double         cpi, sd, total, half;
+  int            halted, pc, instr, op;
+
+  if (warming < 0 || window <= 0 || period < warming + PIPEWARMUP + window) {
+    printf("error: sampling period %d too short for %d warming, %d warm-up "
+           "and %d window instructions\n", period, warming, PIPEWARMUP, window);
+    exit(1);
+  }
+
+  memset(&stat, 0, sizeof(sampleStatType));
+  if (outOfOrder)
+    oooInit(st);
+  else
+    pipeInit();
+
+  fastForward = period - warming - PIPEWARMUP - window;
+  halted = 0;
+  while (!halted) {
+    for (n = 0; n < fastForward + warming && !halted; n++) {
+      pc = st->pc;
+      instr = (pc >= 0 && pc < NUMMEMORY) ? st->instrMem[pc] : 0;
+      op = opcode(instr);
+      if (n >= fastForward && (op == LW || op == SW))
+        dcacheWarm(st->reg[field0(instr)] + CONVERT_TO_32(field2(instr)));
+      halted = funcStep(st);
+      stat.functional++;
+      if (outOfOrder && n >= fastForward && op == BEQ)
+        oooWarmBranch(pc, st->pc != pc + 1);
+    }
+    if (halted)
+      break;
+    if (outOfOrder)
+      halted = sampleOutOfOrder(window, &stat);
+    else
+      halted = sampleInOrder(st, window, &stat);
+  }
+
+  printf("machine halted\n");
+  printf("sampled simulation (%s): period %d, warming %d, window %d\n",
+         outOfOrder ? "out-of-order" : "in-order", period, warming, window);
+  printf("\tinstructions executed %lld (%lld in detailed mode)\n",
+         stat.functional + stat.detailed, stat.detailed);
+  printf("\twindows measured %d\n", stat.windows);
+  if (stat.windows == 0) {
+    printf("\tno complete detailed window; "
+           "program shorter than one sampling period\n");
+  } else {
+    cpi = stat.mean;
+    sd = stat.windows > 1 ? sqrt(stat.m2 / (stat.windows - 1)) : 0.0;
+    total = cpi * (stat.functional + stat.detailed);
+    half = Z95 * sd / sqrt(stat.windows) * (stat.functional + stat.detailed);
+    printf("\tCPI %.4f (stddev %.4f)\n", cpi, sd);
+    printf("\testimated total of %.0f cycles (95%% confidence +/- %.0f)\n",
+           total, half);
+  }
+  dcacheReport();
+  printArchState(st);
+}
+
+/*
+ * Tells whether a correct-path halt is in IF/ID, ID/EX or EX/MEM.
+ */
+static int
+haltInFlight(stateType *st)
+{
+  return (st->IFID.valid && opcode(st->IFID.instr) == HALT)
+         || (st->IDEX.valid && opcode(st->IDEX.instr) == HALT)
+         || (st->EXMEM.valid && opcode(st->EXMEM.instr) == HALT);
+}
+
+/*
+ * Runs one detailed window on the in-order pipeline starting from the
+ * architectural state in *st (which is the global pipeline state).
+ * Returns 1 if the program halted.
+ */
+static int
+sampleInOrder(stateType *st, int window, sampleStatType *stat)
+{
+  long long start;
+  int       c0, c1, drain, halted;
+
+  initState(st);
+  st->memStall = st->memDone = 0;
+  fetchGated = 0;
+  start = perf.retired;
+  c0 = c1 = -1;
+  halted = 0;
+
+  /* a halt fetched behind a taken beq is squashed and must not end the
+     window */
+  while (!(st->MEMWB.valid && opcode(st->MEMWB.instr) == HALT)) {
+    if (c0 < 0 && perf.retired - start >= PIPEWARMUP)
+      c0 = st->cycles;
+    if (perf.retired - start >= PIPEWARMUP + window) {
+      c1 = st->cycles;
+      break;
+    }
+    pipeCycle();
+    if (st->IFID.valid && opcode(st->IFID.instr) == HALT && !fetchGated) {
+      fetchGated = 1;
+      halted = 1;
+    } else if (halted && !haltInFlight(st)) {
+      /* the beq ahead of it was taken; fetch resumes at its target */
+      fetchGated = 0;
+      halted = 0;
+    }
+  }
+
+  /* let everything fetched reach WB before the functional engine resumes */
+  fetchGated = 1;
+  for (drain = 0; drain < 4 && !(st->MEMWB.valid && opcode(st->MEMWB.instr) == HALT); )
+    drain += pipeCycle();
+  fetchGated = 0;
+  if (halted && !(st->MEMWB.valid && opcode(st->MEMWB.instr) == HALT))
+    halted = 0;
+
+  /* halt stops the machine in MEM and never reaches WB */
+  stat->detailed += perf.retired - start + halted;
+  if (c1 >= 0)
+    sampleAddWindow(stat, (double)(c1 - c0) / window);
+  return halted;
+}
+
+static int
+sampleOutOfOrder(int window, sampleStatType *stat)
+{
+  long long start;
+  int       c0, c1, halted;
+
+  oooResume();
+  start = oooCommitted();
+  c0 = c1 = -1;
+  halted = 0;
+
+  while (!halted) {
+    if (c0 < 0 && oooCommitted() - start >= PIPEWARMUP)
+      c0 = oooCycles();
+    if (oooCommitted() - start >= PIPEWARMUP + window) {
+      c1 = oooCycles();
+      break;
+    }
+    halted = oooCycle();
+  }
+  if (!halted)
+    oooDrain();
+
+  stat->detailed += oooCommitted() - start;
+  if (c1 >= 0)
+    sampleAddWindow(stat, (double)(c1 - c0) / window);
+  return halted;
+}
+
+static void
+sampleAddWindow(sampleStatType *stat, double cpi)
+{
+  double delta;
+
+  stat->windows++;
+  delta = cpi - stat->mean;
+  stat->mean += delta / stat->windows;
+  stat->m2 += delta * (cpi - stat->mean);
+}
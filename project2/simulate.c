@@ -1,111 +1,175 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "simulate.h"
 
-#define CONVERT_TO_32(NUM) \
-  ((NUM) & (1 << 15)) ? ((NUM) - (1 << 16)) : (NUM)
-#define ADD_OP(X, Y) ((X) + (Y))
-#define NOR_OP(X, Y) (~((X) | (Y)))
-#define BEQ_OP(X, Y) ((X) - (Y))
-#define MOV_OP(X, Y) ((X) + (Y))
-
-#define NUMREGS           8
-#define NUMMEMORY         65536
-#define MAXLINELENGTH     1000
-
-#define ADD               0
-#define NOR               1
-#define LW                2
-#define SW                3
-#define BEQ               4
-#define JALR              5
-#define HALT              6
-#define NOOP              7
-#define NOOPINSTRUCTION   0x1c00000
-
-typedef struct IFIDStruct { 
-  int instr;
-  int pcPlus1; 
-} IFIDType;
-
-typedef struct IDEXStruct { 
-  int instr;
-  int pcPlus1; 
-  int readRegA; 
-  int readRegB; 
-  int offset;
-} IDEXType;
-
-typedef struct EXMEMStruct { 
-  int instr;
-  int branchTarget; 
-  int aluResult;
-  int readRegB; 
-} EXMEMType;
-
-typedef struct MEMWBStruct { 
-  int instr;
-  int writeData; 
-} MEMWBType;
-
-typedef struct WBENDStruct { 
-  int instr;
-  int writeData; 
-} WBENDType;
-
-typedef struct stateStruct { 
-  int       pc;
-  int       instrMem[NUMMEMORY]; 
-  int       dataMem[NUMMEMORY]; 
-  int       reg[NUMREGS];
-  int       numMemory;
-  IFIDType  IFID;
-  IDEXType  IDEX;
-  EXMEMType EXMEM;
-  MEMWBType MEMWB;
-  WBENDType WBEND;
-  int       cycles;
-} stateType;
-
-void      printState(stateType*);
-void      printInstruction(int);
-void      initState(stateType*);
 void      initIFID(IFIDType*);
 void      initIDEX(IDEXType*);
 void      initEXMEM(EXMEMType*);
 void      initMEMWB(MEMWBType*);
 void      initWBEND(WBENDType*);
 
+void      usage(char*);
+int       destReg(int);
+void      countHazard(int);
+void      countOccupancy(long long);
+void      copyState(stateType*, stateType*);
+
 void      IF_stage();
 void      ID_stage();
 void      EX_stage();
 void      MEM_stage();
 void      WB_stage();
 
-int       field0(int);
-int       field1(int);
-int       field2(int);
-int       opcode(int);
-
 FILE      *filePtr;
 stateType state;
 stateType newState;
+int       fetchGated;
+int       cycleSkip = 1;
+
+static const char *stageName[5] = { "IF", "ID", "EX", "MEM", "WB" };
+
+void
+usage(char *prog)
+{
+  printf("error: usage: %s [-o] [-m latency] [-E] [-j file [-i cycles]] "
+         "[-S period [-w warming] [-d window]] [-l file] [-f rr|ready] [-M] "
+         "<machine-code file>...\n", prog);
+  printf("\t-o\t\tuse the out-of-order core instead of the 5-stage pipeline\n");
+  printf("\t-m latency\tmodel a data cache with the given miss latency\n");
+  printf("\t-E\t\tstep through stalled cycles one by one instead of "
+         "skipping them\n");
+  printf("\t-j file\t\twrite performance counters to file as JSON\n");
+  printf("\t-i cycles\tadd an interval sample to the JSON every cycles "
+         "cycles\n");
+  printf("\t-S period\tsampled simulation, one detailed window per period "
+         "instructions\n");
+  printf("\t-w warming\tfunctional cache/predictor warming before each window "
+         "(default 1000)\n");
+  printf("\t-d window\tdetailed instructions measured per window "
+         "(default 1000)\n");
+  printf("\t-l file\t\twrite a binary cycle log for pipeview instead of "
+         "printing the state\n\t\t\tof every cycle\n");
+  printf("\tseveral machine-code files run as hardware threads on the "
+         "5-stage pipeline:\n");
+  printf("\t-f rr|ready\tfetch round-robin, or only from threads with "
+         "nothing in IFID..EXMEM\n");
+  printf("\t-M\t\tthreads share the first program's data memory\n");
+  exit(1);
+}
 
 int 
 main(int argc, char *argv[])
 {
   char line[MAXLINELENGTH];
   int i;
+  int opt;
+  int outOfOrder;
+  int period, warming, window;
+  char *jsonPath;
+  char *logPath;
+  int advanced;
 
   filePtr = 0;
-  if (argc != 2) {
-    printf("error: usage: %s <machine-code file>\n", argv[0]);
+  outOfOrder = 0;
+  period = 0;
+  warming = 1000;
+  window = 1000;
+  jsonPath = NULL;
+  logPath = NULL;
+  advanced = 0;
+  while ((opt = getopt(argc, argv, "om:Ej:i:S:w:d:l:f:M")) != -1) {
+    switch (opt) {
+      case 'o':
+        outOfOrder = 1;
+        break;
+      case 'm':
+        dcacheMissLatency = atoi(optarg);
+        break;
+      case 'E':
+        cycleSkip = 0;
+        break;
+      case 'j':
+        jsonPath = optarg;
+        break;
+      case 'i':
+        perfInterval = atoi(optarg);
+        break;
+      case 'S':
+        period = atoi(optarg);
+        break;
+      case 'w':
+        warming = atoi(optarg);
+        break;
+      case 'd':
+        window = atoi(optarg);
+        break;
+      case 'l':
+        logPath = optarg;
+        break;
+      case 'f':
+        if (!strcmp(optarg, "rr"))
+          fetchPolicy = FETCH_RR;
+        else if (!strcmp(optarg, "ready"))
+          fetchPolicy = FETCH_READY;
+        else
+          usage(argv[0]);
+        break;
+      case 'M':
+        sharedMem = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (argc - optind < 1 || argc - optind > MAXTHREADS)
+    usage(argv[0]);
+
+  if (logPath && (period || outOfOrder)) {
+    printf("error: the cycle log covers only the 5-stage pipeline\n");
     exit(1);
   }
 
-  filePtr = fopen(argv[1], "r");
+  numThreads = argc - optind;
+  if (numThreads > 1) {
+    if (period || outOfOrder) {
+      printf("error: several programs run only on the 5-stage pipeline\n");
+      exit(1);
+    }
+    initState(&state);
+    threadLoad(argv + optind);
+    pipeInit();
+    if (logPath)
+      logOpen(logPath);
+    while (1) {
+      if (cycleLog)
+        logCycle(&state, advanced);
+      else
+        printState(&state);
+      if (threadHalted()) {
+        perf.retired += numThreads;
+        perf.opcodes[HALT] += numThreads;
+        printf("machine halted\n");
+        printf("total of %d cycles executed\n", state.cycles);
+        threadReport();
+        dcacheReport();
+        break;
+      }
+      advanced = pipeCycle();
+    }
+    if (cycleLog)
+      logClose();
+    if (jsonPath)
+      perfWriteJson(jsonPath);
+    exit(0);
+  }
+
+  filePtr = fopen(argv[optind], "r");
   if (filePtr == NULL) {
-    printf("error: can't open file %s", argv[1]);
+    printf("error: can't open file %s", argv[optind]);
     perror("fopen");
     exit(1);
   }
@@ -128,49 +192,195 @@ main(int argc, char *argv[])
     printInstruction(state.instrMem[i]);
   }
 
-  while (1) { 
-    printState(&state);
-    if (opcode(state.MEMWB.instr) == HALT) {
-      printf("machine halted\n");
-      printf("total of %d cycles executed\n", state.cycles); 
-      exit(0);
+  if (period) {
+    sampleRun(&state, outOfOrder, period, warming, window);
+  } else if (outOfOrder) {
+    oooRun(&state);
+  } else {
+    pipeInit();
+    if (logPath)
+      logOpen(logPath);
+    while (1) { 
+      if (cycleLog)
+        logCycle(&state, advanced);
+      else
+        printState(&state);
+      if (opcode(state.MEMWB.instr) == HALT) {
+        perf.retired++;
+        perf.opcodes[HALT]++;
+        printf("machine halted\n");
+        printf("total of %d cycles executed\n", state.cycles); 
+        dcacheReport();
+        break;
+      }
+      advanced = pipeCycle();
+    }
+    if (cycleLog)
+      logClose();
+  }
+
+  if (jsonPath)
+    perfWriteJson(jsonPath);
+  exit(0);
+}
+
+void
+pipeInit()
+{
+  perfInit("in-order", 5, stageName);
+}
+
+/*
+ * Advances the pipeline by one cycle.  A data-cache miss freezes every
+ * stage until the block returns; since only the stall counter changes
+ * meanwhile, the whole stall is normally skipped in a single call with
+ * state.cycles advanced by its length.  Returns 1 if the stages advanced,
+ * 0 for a stalled call.
+ */
+int
+pipeCycle()
+{
+  int op, idle;
+
+  /* with threads, an empty pipeline whose threads all wait on misses
+     has nothing to do until the first miss returns */
+  if (numThreads > 1 && cycleSkip && (idle = threadIdleCycles()) > 0) {
+    state.cycles += idle;
+    perf.cycles += idle;
+    perf.stalls[STALL_MEMORY] += idle;
+    countOccupancy(idle);
+    initState(&state);
+  }
+
+  copyState(&newState, &state);
+  newState.cycles++;
+
+  op = opcode(state.EXMEM.instr);
+  if (numThreads == 1 && (op == LW || op == SW) && !state.memDone) {
+    newState.memStall = dcacheAccess(state.EXMEM.aluResult);
+    newState.memDone = 1;
+  }
+  if (newState.memStall > 0) {
+    if (cycleSkip) {
+      newState.cycles += newState.memStall - 1;
+      newState.memStall = 0;
+    } else {
+      newState.memStall--;
     }
-    newState = state; 
-    newState.cycles++;
+    perf.cycles += newState.cycles - state.cycles;
+    perf.stalls[STALL_MEMORY] += newState.cycles - state.cycles;
+    countOccupancy(newState.cycles - state.cycles);
+    PERFSAMPLE();
+    copyState(&state, &newState);
+    return 0;
+  }
+  newState.memDone = 0;
+  perf.cycles++;
+  countOccupancy(1);
 
-    /* --------------------- IF stage --------------------- */
+  /* --------------------- IF stage --------------------- */
 
-    IF_stage(); 
+  IF_stage(); 
 
-    /* --------------------- ID stage --------------------- */
+  /* --------------------- ID stage --------------------- */
 
-    ID_stage();
+  ID_stage();
 
-    /* --------------------- EX stage --------------------- */
+  /* --------------------- EX stage --------------------- */
 
-    EX_stage();
+  EX_stage();
 
-    /* --------------------- MEM stage --------------------- */
+  /* --------------------- MEM stage --------------------- */
 
-    MEM_stage();
+  MEM_stage();
+
+  /* --------------------- WB stage --------------------- */
+
+  WB_stage();
+    
+  copyState(&state, &newState); /* this is the last statement of the cycle.
+                       It marks the end of the cycle and updates the 
+                       current state with the values calculated in this
+                       cycle */
+  PERFSAMPLE();
+  return 1;
+}
+
+/*
+ * Copies everything but the memories.  Instruction memory never changes
+ * and MEM, the only stage that touches data memory, writes state's copy
+ * in place, so the per-cycle copy stays independent of memory size.
+ */
+void
+copyState(stateType *dst, stateType *src)
+{
+  dst->pc = src->pc;
+  memcpy(dst->reg, src->reg, sizeof(stateType) - offsetof(stateType, reg));
+}
+
+/*
+ * Charges n cycles to every stage currently holding an instruction.
+ */
+void
+countOccupancy(long long n)
+{
+  perf.unitBusy[0] += fetchGated ? 0 : n;
+  perf.unitBusy[1] += state.IFID.valid ? n : 0;
+  perf.unitBusy[2] += state.IDEX.valid ? n : 0;
+  perf.unitBusy[3] += state.EXMEM.valid ? n : 0;
+  perf.unitBusy[4] += state.MEMWB.valid ? n : 0;
+}
 
-    /* --------------------- WB stage --------------------- */
+/*
+ * Counts a read of reg in ID that an older instruction still in flight
+ * will overwrite.  The pipeline has no interlocks, so the stale value is
+ * used; these are reported as hazards rather than stall cycles.
+ */
+void
+countHazard(int reg)
+{
+  int tid = state.IFID.tid;
+
+  if (state.IDEX.valid && state.IDEX.tid == tid
+      && destReg(state.IDEX.instr) == reg)
+    perf.hazards[opcode(state.IDEX.instr) == LW ? STALL_LOADUSE
+                                                : STALL_DATA]++;
+  else if ((state.EXMEM.valid && state.EXMEM.tid == tid
+            && destReg(state.EXMEM.instr) == reg)
+           || (state.MEMWB.valid && state.MEMWB.tid == tid
+               && destReg(state.MEMWB.instr) == reg))
+    perf.hazards[STALL_DATA]++;
+}
 
-    WB_stage();
-      
-    state = newState; /* this is the last statement before end of the loop.
-                         It marks the end of the cycle and updates the 
-                         current state with the values calculated in this
-                         cycle */
+int
+destReg(int instr)
+{
+  switch (opcode(instr)) {
+    case ADD:
+    case NOR:
+      return field2(instr) & 0x7;
+    case LW:
+      return field1(instr);
   }
-  return 0;
+  return -1;
 }
 
 void
 IF_stage()
 {
+  if (fetchGated) {
+    newState.IFID.instr = NOOPINSTRUCTION;
+    newState.IFID.pcPlus1 = state.pc;
+    newState.IFID.valid = 0;
+    return;
+  }
+  if (numThreads > 1) {
+    threadFetch();
+    return;
+  }
   newState.IFID.instr = state.instrMem[state.pc];
   newState.IFID.pcPlus1 = state.pc + 1;
+  newState.IFID.valid = 1;
   newState.pc++;
 }
 
@@ -183,10 +393,29 @@ ID_stage()
   regB   = field1(state.IFID.instr);
   offset = field2(state.IFID.instr);
   
+  if (state.IFID.valid) {
+    switch (opcode(state.IFID.instr)) {
+      case ADD:
+      case NOR:
+      case SW:
+      case BEQ:
+        countHazard(regA);
+        if (regB != regA)
+          countHazard(regB);
+        break;
+      case LW:
+      case JALR:
+        countHazard(regA);
+        break;
+    }
+  }
+
   newState.IDEX.instr = state.IFID.instr;
   newState.IDEX.pcPlus1 = state.IFID.pcPlus1;
-  newState.IDEX.readRegA = state.reg[regA];
-  newState.IDEX.readRegB = state.reg[regB];
+  newState.IDEX.valid = state.IFID.valid;
+  newState.IDEX.tid = state.IFID.tid;
+  newState.IDEX.readRegA = REGFILE(state, state.IFID.tid)[regA];
+  newState.IDEX.readRegB = REGFILE(state, state.IFID.tid)[regB];
   newState.IDEX.offset = CONVERT_TO_32(offset);
 }
 
@@ -218,6 +447,9 @@ EX_stage()
   }
 
   newState.EXMEM.instr = state.IDEX.instr;
+  newState.EXMEM.valid = state.IDEX.valid;
+  newState.EXMEM.tid = state.IDEX.tid;
+  newState.EXMEM.pcPlus1 = state.IDEX.pcPlus1;
   newState.EXMEM.branchTarget = state.IDEX.pcPlus1 + state.IDEX.offset;
   newState.EXMEM.readRegB = state.IDEX.readRegB;
 }
@@ -225,22 +457,66 @@ EX_stage()
 void
 MEM_stage()
 {
+  int tid, op, stall;
+
+  tid = state.EXMEM.tid;
+  op = opcode(state.EXMEM.instr);
+  if (numThreads > 1 && state.EXMEM.valid && (op == LW || op == SW)) {
+    if (thread[tid].filled) {
+      /* the block this access waited for is delivered to it directly,
+         even if another thread has evicted it since */
+      thread[tid].filled = 0;
+      stall = 0;
+    } else {
+      stall = dcacheAccess(threadAddr(tid, state.EXMEM.aluResult));
+    }
+    if (stall > 0) {
+      threadReplay(tid, state.EXMEM.pcPlus1 - 1, state.cycles + stall);
+      return;
+    }
+  }
+
   newState.MEMWB.instr = state.EXMEM.instr;
+  newState.MEMWB.valid = state.EXMEM.valid;
+  newState.MEMWB.tid = tid;
 
-  switch (opcode(state.EXMEM.instr)) {
+  switch (op) {
     case ADD:
     case NOR:
       newState.MEMWB.writeData = state.EXMEM.aluResult;
       break;
     case LW:
-      newState.MEMWB.writeData = state.dataMem[state.EXMEM.aluResult];
+      newState.MEMWB.writeData = DATAMEM(state, tid)[state.EXMEM.aluResult];
       break;
     case SW:
-      newState.dataMem[state.EXMEM.aluResult] = state.EXMEM.readRegB;
+      if (cycleLog
+          && DATAMEM(state, tid)[state.EXMEM.aluResult] != state.EXMEM.readRegB)
+        logMemWrite(tid, state.EXMEM.aluResult, state.EXMEM.readRegB);
+      DATAMEM(state, tid)[state.EXMEM.aluResult] = state.EXMEM.readRegB;
       break;
     case BEQ:
-      if(state.EXMEM.aluResult == 0)
+      if (state.EXMEM.valid)
+        perf.beq++;
+      if(state.EXMEM.aluResult == 0 && numThreads > 1) {
+        if (state.EXMEM.valid) {
+          perf.taken++;
+          perf.mispredicted++;
+          perf.stalls[STALL_CONTROL] += threadSquash(tid);
+          thread[tid].pc = state.EXMEM.branchTarget;
+        }
+      } else if(state.EXMEM.aluResult == 0) {
         newState.pc = state.EXMEM.branchTarget;
+        /* the three younger instructions still execute, but they are not
+           on the architectural path */
+        if (state.EXMEM.valid) {
+          perf.taken++;
+          perf.mispredicted++;
+          perf.stalls[STALL_CONTROL] += newState.IFID.valid
+                                        + newState.IDEX.valid
+                                        + newState.EXMEM.valid;
+        }
+        newState.IFID.valid = newState.IDEX.valid = newState.EXMEM.valid = 0;
+      }
       break;
   }
 }
@@ -248,16 +524,34 @@ MEM_stage()
 void
 WB_stage()
 {
+  int tid, reg, old;
+
+  tid = state.MEMWB.tid;
+  reg = destReg(state.MEMWB.instr);
+  old = reg >= 0 ? REGFILE(newState, tid)[reg] : 0;
+
   switch(opcode(state.MEMWB.instr)) {
     case ADD:
     case NOR:
-      newState.reg[field2(state.MEMWB.instr)] = state.MEMWB.writeData;
+      REGFILE(newState, state.MEMWB.tid)[field2(state.MEMWB.instr)] =
+        state.MEMWB.writeData;
       break;
     case LW:
-      newState.reg[field1(state.MEMWB.instr)] = state.MEMWB.writeData;
+      REGFILE(newState, state.MEMWB.tid)[field1(state.MEMWB.instr)] =
+        state.MEMWB.writeData;
       break;
   }
+  if (cycleLog && reg >= 0 && REGFILE(newState, tid)[reg] != old)
+    logRegWrite(tid, reg, REGFILE(newState, tid)[reg]);
+  if (state.MEMWB.valid) {
+    perf.retired++;
+    thread[state.MEMWB.tid].retired++;
+    perf.opcodes[opcode(state.MEMWB.instr) & 0x7]++;
+    if (opcode(state.MEMWB.instr) == JALR)
+      perf.jalr++;
+  }
   newState.WBEND.instr = state.MEMWB.instr;
+  newState.WBEND.tid = state.MEMWB.tid;
   newState.WBEND.writeData = state.MEMWB.writeData;
 }
 
@@ -267,24 +561,32 @@ printState(stateType *statePtr)
   int i;
 
   printf("\n@@@\nstate before cycle %d starts\n", statePtr->cycles); 
-  printf("\tpc %d\n", statePtr->pc);
-  printf("\tdata memory:\n");
-  for (i = 0; i < statePtr->numMemory; i++) {
-    printf("\t\tdataMem[ %d ] %d\n", i, statePtr->dataMem[i]); 
-  }
-  printf("\tregisters:\n");
-  for (i = 0; i < NUMREGS; i++) {
-    printf("\t\treg[ %d ] %d\n", i, statePtr->reg[i]); 
+  if (numThreads > 1) {
+    threadPrintState();
+  } else {
+    printf("\tpc %d\n", statePtr->pc);
+    printf("\tdata memory:\n");
+    for (i = 0; i < statePtr->numMemory; i++) {
+      printf("\t\tdataMem[ %d ] %d\n", i, statePtr->dataMem[i]); 
+    }
+    printf("\tregisters:\n");
+    for (i = 0; i < NUMREGS; i++) {
+      printf("\t\treg[ %d ] %d\n", i, statePtr->reg[i]); 
+    }
   }
 
   printf("\tIFID:\n"); 
   printf("\t\tinstruction ");
   printInstruction(statePtr->IFID.instr);
+  if (numThreads > 1)
+    printf("\t\tthread %d\n", statePtr->IFID.tid);
   printf("\t\tpcPlus1 %d\n", statePtr->IFID.pcPlus1);
 
   printf("\tIDEX:\n");
   printf("\t\tinstruction "); 
   printInstruction(statePtr->IDEX.instr);
+  if (numThreads > 1)
+    printf("\t\tthread %d\n", statePtr->IDEX.tid);
   printf("\t\tpcPlus1 %d\n", statePtr->IDEX.pcPlus1); 
   printf("\t\treadRegA %d\n", statePtr->IDEX.readRegA); 
   printf("\t\treadRegB %d\n", statePtr->IDEX.readRegB); 
@@ -293,6 +595,8 @@ printState(stateType *statePtr)
   printf("\tEXMEM:\n"); 
   printf("\t\tinstruction ");
   printInstruction(statePtr->EXMEM.instr);
+  if (numThreads > 1)
+    printf("\t\tthread %d\n", statePtr->EXMEM.tid);
   printf("\t\tbranchTarget %d\n", statePtr->EXMEM.branchTarget); 
   printf("\t\taluResult %d\n", statePtr->EXMEM.aluResult); 
   printf("\t\treadRegB %d\n", statePtr->EXMEM.readRegB);
@@ -300,14 +604,35 @@ printState(stateType *statePtr)
   printf("\tMEMWB:\n");
   printf("\t\tinstruction "); 
   printInstruction(statePtr->MEMWB.instr); 
+  if (numThreads > 1)
+    printf("\t\tthread %d\n", statePtr->MEMWB.tid);
   printf("\t\twriteData %d\n", statePtr->MEMWB.writeData);
 
   printf("\tWBEND:\n"); 
   printf("\t\tinstruction ");
   printInstruction(statePtr->WBEND.instr); 
+  if (numThreads > 1)
+    printf("\t\tthread %d\n", statePtr->WBEND.tid);
   printf("\t\twriteData %d\n", statePtr->WBEND.writeData);
 }
 
+void
+printArchState(stateType *statePtr)
+{
+  int i;
+
+  printf("final state of machine:\n");
+  printf("\tpc %d\n", statePtr->pc);
+  printf("\tdata memory:\n");
+  for (i = 0; i < statePtr->numMemory; i++) {
+    printf("\t\tdataMem[ %d ] %d\n", i, statePtr->dataMem[i]);
+  }
+  printf("\tregisters:\n");
+  for (i = 0; i < NUMREGS; i++) {
+    printf("\t\treg[ %d ] %d\n", i, statePtr->reg[i]);
+  }
+}
+
 int
 field0(int instruction)
 {
@@ -364,6 +689,7 @@ initIFID(IFIDType* ifid)
 {
   ifid->pcPlus1 = 0;
   ifid->instr   = NOOPINSTRUCTION;
+  ifid->valid   = 0;
 }
 
 void
@@ -378,6 +704,7 @@ initEXMEM(EXMEMType* exmem)
 {
   memset(exmem, 0, sizeof(exmem));
   exmem->instr = NOOPINSTRUCTION;
+  exmem->valid = 0;
 }
 
 void
@@ -385,6 +712,7 @@ initMEMWB(MEMWBType* memwb)
 {
   memwb->writeData = 0;
   memwb->instr = NOOPINSTRUCTION;
+  memwb->valid = 0;
 }
 
 void
@@ -0,0 +1,210 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include <stdio.h>
+
+#define CONVERT_TO_32(NUM) \
+  ((NUM) & (1 << 15)) ? ((NUM) - (1 << 16)) : (NUM)
+#define ADD_OP(X, Y) ((X) + (Y))
+#define NOR_OP(X, Y) (~((X) | (Y)))
+#define BEQ_OP(X, Y) ((X) - (Y))
+#define MOV_OP(X, Y) ((X) + (Y))
+
+#define NUMREGS           8
+#define NUMMEMORY         65536
+#define MAXLINELENGTH     1000
+
+#define ADD               0
+#define NOR               1
+#define LW                2
+#define SW                3
+#define BEQ               4
+#define JALR              5
+#define HALT              6
+#define NOOP              7
+#define NOOPINSTRUCTION   0x1c00000
+
+typedef struct IFIDStruct {
+  int instr;
+  int pcPlus1;
+  int valid;      /* fetched on the correct path, not a bubble */
+  int tid;        /* hardware thread of the instruction */
+} IFIDType;
+
+typedef struct IDEXStruct {
+  int instr;
+  int pcPlus1;
+  int readRegA;
+  int readRegB;
+  int offset;
+  int valid;      /* fetched on the correct path, not a bubble */
+  int tid;        /* hardware thread of the instruction */
+} IDEXType;
+
+typedef struct EXMEMStruct {
+  int instr;
+  int pcPlus1;
+  int branchTarget;
+  int aluResult;
+  int readRegB;
+  int valid;      /* fetched on the correct path, not a bubble */
+  int tid;        /* hardware thread of the instruction */
+} EXMEMType;
+
+typedef struct MEMWBStruct {
+  int instr;
+  int writeData;
+  int valid;      /* fetched on the correct path, not a bubble */
+  int tid;        /* hardware thread of the instruction */
+} MEMWBType;
+
+typedef struct WBENDStruct {
+  int instr;
+  int writeData;
+  int tid;        /* hardware thread of the instruction */
+} WBENDType;
+
+typedef struct stateStruct {
+  int       pc;
+  int       instrMem[NUMMEMORY];
+  int       dataMem[NUMMEMORY];
+  int       reg[NUMREGS];     /* copyState copies from here on */
+  int       numMemory;
+  IFIDType  IFID;
+  IDEXType  IDEX;
+  EXMEMType EXMEM;
+  MEMWBType MEMWB;
+  WBENDType WBEND;
+  int       cycles;
+  int       memStall;   /* cycles the access in EXMEM still waits */
+  int       memDone;    /* the access in EXMEM has been sent to the cache */
+} stateType;
+
+extern stateType state;
+extern stateType newState;
+extern int       fetchGated;
+extern int       cycleSkip;
+
+void      initState(stateType*);
+void      pipeInit(void);
+int       pipeCycle(void);
+void      printState(stateType*);
+void      printArchState(stateType*);
+void      printInstruction(int);
+
+int       field0(int);
+int       field1(int);
+int       field2(int);
+int       opcode(int);
+
+/* hardware thread contexts for fine-grained multithreading (thread.c) */
+#define MAXTHREADS        8
+#define FETCH_RR          0
+#define FETCH_READY       1
+
+typedef struct threadStruct {
+  int       pc;
+  int       reg[NUMREGS];
+  int      *instrMem;
+  int      *dataMem;
+  int       numMemory;
+  int       fetchDone;    /* halt fetched, stop fetching */
+  int       halted;
+  int       haltCycle;
+  int       readyCycle;   /* no fetch before this cycle (miss replay) */
+  int       filled;       /* the replayed access gets its block */
+  long long retired;
+  long long replays;
+} threadType;
+
+extern threadType thread[MAXTHREADS];
+extern int        numThreads;
+extern int        fetchPolicy;
+extern int        sharedMem;
+
+/* register file and data memory of a latch's thread; a single program
+   keeps using the double-buffered copies inside stateType */
+#define REGFILE(st, tid)  (numThreads > 1 ? thread[tid].reg : (st).reg)
+#define DATAMEM(st, tid)  (numThreads > 1 ? thread[tid].dataMem : (st).dataMem)
+
+void      threadLoad(char**);
+void      threadFetch(void);
+int       threadSquash(int);
+void      threadReplay(int, int, int);
+int       threadHalted(void);
+int       threadIdleCycles(void);
+int       threadAddr(int, int);
+void      threadReport(void);
+void      threadPrintState(void);
+
+/* out-of-order engine (ooo.c) */
+void      oooRun(stateType*);
+void      oooInit(stateType*);
+int       oooCycle(void);
+void      oooDrain(void);
+void      oooResume(void);
+void      oooReport(void);
+void      oooWarmBranch(int, int);
+long long oooCommitted(void);
+int       oooCycles(void);
+
+/* data cache latency model (dcache.c) */
+extern int       dcacheMissLatency;
+extern long long dcacheHits;
+extern long long dcacheMisses;
+
+int       dcacheAccess(int);
+void      dcacheWarm(int);
+void      dcacheReport(void);
+
+/* performance counters (perf.c) */
+#define STALL_DATA        0
+#define STALL_LOADUSE     1
+#define STALL_CONTROL     2
+#define STALL_STRUCTURAL  3
+#define STALL_MEMORY      4
+#define NUMSTALLS         5
+#define MAXUNITS          8
+
+typedef struct perfStruct {
+  const char *engine;
+  long long   cycles;
+  long long   retired;
+  long long   stalls[NUMSTALLS];
+  long long   hazards[NUMSTALLS];   /* RAW hazards the in-order pipeline
+                                       executes through without a stall */
+  long long   beq;
+  long long   taken;
+  long long   mispredicted;
+  long long   jalr;
+  long long   opcodes[8];
+  int         numUnits;
+  const char *unitName[MAXUNITS];
+  long long   unitBusy[MAXUNITS];
+} perfType;
+
+extern perfType  perf;
+extern int       perfInterval;
+extern long long perfNextSample;
+
+#define PERFSAMPLE() \
+  do { if (perfInterval && perf.cycles >= perfNextSample) perfSample(); } while (0)
+
+void      perfInit(const char*, int, const char**);
+void      perfSample(void);
+void      perfWriteJson(const char*);
+
+/* binary cycle log for pipeview (cyclelog.c) */
+extern FILE     *cycleLog;
+
+void      logOpen(const char*);
+void      logCycle(stateType*, int);
+void      logRegWrite(int, int, int);
+void      logMemWrite(int, int, int);
+void      logClose(void);
+
+/* functional fast-forward and sampled simulation (sample.c) */
+int       funcStep(stateType*);
+void      sampleRun(stateType*, int, int, int, int);
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simulate.h"
+
+/*
+ * Fine-grained multithreading for the 5-stage pipeline.
+ *
+ * With more than one machine-code file each program gets a hardware
+ * thread context (pc, register file, instruction memory and a private or
+ * shared data memory) and IF picks one thread per cycle.  Every latch
+ * carries the id of the thread its instruction belongs to, so ID, MEM and
+ * WB use that thread's registers and memory.
+ *
+ * Unlike the single-program pipeline, a taken beq squashes the younger
+ * instructions of its own thread, since how many of them were fetched
+ * depends on the interleaving.  A data-cache miss does not freeze the
+ * pipeline either: the access and the younger instructions of its thread
+ * are squashed, and the thread refetches the lw/sw once the block has
+ * returned while the other threads keep issuing.  The replayed access is
+ * handed the block it waited for, so threads whose blocks conflict in the
+ * cache cannot evict each other's fills forever.
+ *
+ * FETCH_RR takes the next thread in round-robin order that can fetch;
+ * FETCH_READY additionally skips threads that still have an instruction
+ * in IFID, IDEX or EXMEM, which keeps every thread free of data and
+ * control hazards without noops.
+ */
+
+threadType       thread[MAXTHREADS];
+int              numThreads = 1;
+int              fetchPolicy = FETCH_RR;
+int              sharedMem;
+
+static int       lastFetched = -1;
+
+static int       threadCanFetch(int);
+
+void
+threadLoad(char **paths)
+{
+  char  line[MAXLINELENGTH];
+  FILE *fp;
+  int   t, i;
+
+  for (t = 0; t < numThreads; t++) {
+    threadType *th = &thread[t];
+
+    fp = fopen(paths[t], "r");
+    if (fp == NULL) {
+      printf("error: can't open file %s", paths[t]);
+      perror("fopen");
+      exit(1);
+    }
+    th->instrMem = calloc(NUMMEMORY, sizeof(int));
+    th->dataMem = (sharedMem && t > 0) ? thread[0].dataMem
+                                       : calloc(NUMMEMORY, sizeof(int));
+    if (!th->instrMem || !th->dataMem) {
+      printf("error: out of memory for thread %d\n", t);
+      exit(1);
+    }
+
+    printf("thread %d: %s\n", t, paths[t]);
+    for (th->numMemory = 0; fgets(line, MAXLINELENGTH, fp); th->numMemory++) {
+      if (sscanf(line, "%d", th->instrMem + th->numMemory) != 1) {
+        printf("error in reading address %d\n", th->numMemory);
+        exit(1);
+      }
+      printf("memory[%d]=%d\n", th->numMemory, th->instrMem[th->numMemory]);
+      if (!sharedMem || t == 0)
+        th->dataMem[th->numMemory] = th->instrMem[th->numMemory];
+    }
+    fclose(fp);
+
+    printf("%d memory words\n", th->numMemory);
+    printf("\tinstruction memory:\n");
+    for (i = 0; i < th->numMemory; i++) {
+      printf("\t\tinstrMem[ %d ] ", i);
+      printInstruction(th->instrMem[i]);
+    }
+  }
+}
+
+/*
+ * IF stage in multithreaded mode.
+ */
+void
+threadFetch(void)
+{
+  threadType *th;
+  int         i, t;
+
+  t = -1;
+  for (i = 1; i <= numThreads; i++) {
+    if (threadCanFetch((lastFetched + i) % numThreads)) {
+      t = (lastFetched + i) % numThreads;
+      break;
+    }
+  }
+  if (t < 0) {
+    newState.IFID.instr = NOOPINSTRUCTION;
+    newState.IFID.pcPlus1 = 0;
+    newState.IFID.valid = 0;
+    newState.IFID.tid = 0;
+    return;
+  }
+
+  th = &thread[t];
+  lastFetched = t;
+  newState.IFID.instr = th->instrMem[th->pc];
+  newState.IFID.pcPlus1 = th->pc + 1;
+  newState.IFID.valid = 1;
+  newState.IFID.tid = t;
+  if (opcode(newState.IFID.instr) == HALT)
+    th->fetchDone = 1;
+  th->pc++;
+}
+
+/*
+ * Turns the younger instructions of thread tid already in the pipeline
+ * into bubbles; returns how many there were.
+ */
+int
+threadSquash(int tid)
+{
+  int n = 0;
+
+  if (newState.IFID.valid && newState.IFID.tid == tid) {
+    newState.IFID.instr = NOOPINSTRUCTION;
+    newState.IFID.valid = 0;
+    n++;
+  }
+  if (newState.IDEX.valid && newState.IDEX.tid == tid) {
+    newState.IDEX.instr = NOOPINSTRUCTION;
+    newState.IDEX.valid = 0;
+    n++;
+  }
+  if (newState.EXMEM.valid && newState.EXMEM.tid == tid) {
+    newState.EXMEM.instr = NOOPINSTRUCTION;
+    newState.EXMEM.valid = 0;
+    n++;
+  }
+  /* a halt fetched down the wrong path must not stop the thread */
+  thread[tid].fetchDone = 0;
+  return n;
+}
+
+/*
+ * Squashes the lw/sw of thread tid in MEM along with its younger
+ * instructions and restarts the thread at pc once readyCycle is reached.
+ */
+void
+threadReplay(int tid, int pc, int readyCycle)
+{
+  threadSquash(tid);
+  newState.MEMWB.instr = NOOPINSTRUCTION;
+  newState.MEMWB.valid = 0;
+  newState.MEMWB.tid = tid;
+  thread[tid].pc = pc;
+  thread[tid].readyCycle = readyCycle;
+  thread[tid].filled = 1;
+  thread[tid].replays++;
+}
+
+/*
+ * Checks for a halt in MEMWB; returns 1 once every thread has halted.
+ */
+int
+threadHalted(void)
+{
+  int t;
+
+  if (state.MEMWB.valid && opcode(state.MEMWB.instr) == HALT
+      && !thread[state.MEMWB.tid].halted) {
+    thread[state.MEMWB.tid].halted = 1;
+    thread[state.MEMWB.tid].haltCycle = state.cycles;
+    thread[state.MEMWB.tid].retired++;
+  }
+  for (t = 0; t < numThreads; t++) {
+    if (!thread[t].halted)
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * Number of upcoming cycles in which nothing can happen: the pipeline is
+ * empty and every live thread waits for a miss to return.
+ */
+int
+threadIdleCycles(void)
+{
+  int t, next;
+
+  if (state.IFID.valid || state.IDEX.valid || state.EXMEM.valid
+      || state.MEMWB.valid)
+    return 0;
+  next = -1;
+  for (t = 0; t < numThreads; t++) {
+    if (thread[t].halted || thread[t].fetchDone)
+      continue;
+    if (thread[t].readyCycle <= state.cycles)
+      return 0;
+    if (next < 0 || thread[t].readyCycle < next)
+      next = thread[t].readyCycle;
+  }
+  return next < 0 ? 0 : next - state.cycles;
+}
+
+/*
+ * Address seen by the data cache: private memories do not alias.
+ */
+int
+threadAddr(int tid, int addr)
+{
+  return sharedMem ? addr : tid * NUMMEMORY + addr;
+}
+
+void
+threadReport(void)
+{
+  long long total;
+  int       t;
+
+  total = 0;
+  for (t = 0; t < numThreads; t++) {
+    printf("thread %d: %lld instructions retired, halted at cycle %d, "
+           "%lld miss replays\n", t, thread[t].retired, thread[t].haltCycle,
+           thread[t].replays);
+    total += thread[t].retired;
+  }
+  printf("%d threads (%s fetch, %s data memory): throughput IPC %.3f\n",
+         numThreads, fetchPolicy == FETCH_RR ? "round-robin" : "ready",
+         sharedMem ? "shared" : "private",
+         state.cycles ? (double)total / state.cycles : 0.0);
+}
+
+void
+threadPrintState(void)
+{
+  int t, i;
+
+  for (t = 0; t < numThreads; t++) {
+    printf("\tthread %d:\n", t);
+    printf("\t\tpc %d\n", thread[t].pc);
+    if (t == 0 || !sharedMem) {
+      printf("\t\tdata memory:\n");
+      for (i = 0; i < thread[t].numMemory; i++)
+        printf("\t\t\tdataMem[ %d ] %d\n", i, thread[t].dataMem[i]);
+    }
+    printf("\t\tregisters:\n");
+    for (i = 0; i < NUMREGS; i++)
+      printf("\t\t\treg[ %d ] %d\n", i, thread[t].reg[i]);
+  }
+}
+
+static int
+threadCanFetch(int t)
+{
+  if (thread[t].halted || thread[t].fetchDone
+      || thread[t].readyCycle > state.cycles)
+    return 0;
+  if (fetchPolicy == FETCH_READY
+      && ((state.IFID.valid && state.IFID.tid == t)
+          || (state.IDEX.valid && state.IDEX.tid == t)
+          || (state.EXMEM.valid && state.EXMEM.tid == t)))
+    return 0;
+  return 1;
+}
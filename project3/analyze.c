@@ -0,0 +1,290 @@
+#include "analyze.h"
+#include "sweep.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FAIL        (1)
+#define SAR(X, Y)   ((X) >> (Y))
+#define SHL(X, Y)   ((X) << (Y))
+
+#define NO_REGION   (UINT64_MAX)    // empty hash slot
+#define BUCKETS     (65)            // log2 buckets of a 64-bit count
+
+// miss analysis.
+//
+// the shadow is a fully associative LRU cache of every size at once: the
+// LRU stack distance of each access over all blocks, counted as in the
+// sweep. a miss is compulsory on the first access to its block, capacity
+// if the distance is at least the number of lines, so that a fully
+// associative LRU cache of the same size would miss too, and conflict
+// otherwise. histograms use log2 buckets: bucket 0 holds 0, bucket k
+// holds [2^(k-1), 2^k).
+
+typedef struct region_t {
+    uint64_t    base;
+    int64_t     hit;
+    int64_t     miss;
+    int64_t     compulsory;
+    int64_t     capacity;
+    int64_t     conflict;
+    int64_t     evicted;        // its blocks evicted
+} region_t;
+
+typedef struct pressure_t {
+    int64_t     access;
+    int64_t     miss;
+    int64_t     evict;
+    int64_t     conflict;
+} pressure_t;
+
+static cache_t*     target;
+static int          region_bits;
+static int64_t      lines;
+static sd_conf_t*   shadow;
+
+static int64_t      cold;
+static int64_t      reuse[BUCKETS];
+static int64_t      compulsory;
+static int64_t      capacity;
+static int64_t      conflict;
+
+static region_t*    region;
+static size_t       nregions;
+static size_t       region_cap;
+static uint64_t*    rkey;           // region -> index, open addressing
+static size_t*      rval;
+static size_t       rcap;
+
+static pressure_t*  set;
+
+static inline int
+bucket(uint64_t v)
+{
+    return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+static inline size_t
+hash_region(uint64_t r, size_t cap)
+{
+    r *= 0x9e3779b97f4a7c15ULL;
+    return (size_t)(r >> 32) & (cap - 1);
+}
+
+static inline size_t
+rhash_find(uint64_t r)
+{
+    size_t  h = hash_region(r, rcap);
+
+    while(rkey[h] != NO_REGION && rkey[h] != r)
+        h = (h + 1) & (rcap - 1);
+    return h;
+}
+
+static void
+rhash_grow()
+{
+    uint64_t*   key = rkey;
+    size_t*     val = rval;
+    size_t      cap = rcap;
+    size_t      h;
+
+    rcap = cap ? 2 * cap : 1024;
+    rkey = (uint64_t*)malloc(sizeof(uint64_t) * rcap);
+    rval = (size_t*)malloc(sizeof(size_t) * rcap);
+    if(!rkey || !rval) exit(FAIL);
+    memset(rkey, 0xff, sizeof(uint64_t) * rcap);
+    for(size_t i=0; i<cap; i++) {
+        if(key[i] == NO_REGION) continue;
+        h = rhash_find(key[i]);
+        rkey[h] = key[i];
+        rval[h] = val[i];
+    }
+    free(key);
+    free(val);
+}
+
+static region_t*
+region_of(uint64_t address)
+{
+    uint64_t    r = SAR(address, region_bits);
+    size_t      h = rhash_find(r);
+
+    if(rkey[h] == r) return &region[rval[h]];
+    if(2 * (nregions + 1) > rcap) {
+        rhash_grow();
+        h = rhash_find(r);
+    }
+    if(nregions == region_cap) {
+        region_cap = region_cap ? 2 * region_cap : 256;
+        region = (region_t*)realloc(region, sizeof(region_t) * region_cap);
+        if(!region) exit(FAIL);
+    }
+    rkey[h] = r;
+    rval[h] = nregions;
+    memset(&region[nregions], 0, sizeof(region_t));
+    region[nregions].base = r;
+    return &region[nregions++];
+}
+
+void
+an_init(cache_t* c, int bits)
+{
+    target = c;
+    region_bits = bits;
+    lines = (int64_t)c->S * c->E;
+    shadow = sd_new(0, c->b);
+    rhash_grow();
+    set = (pressure_t*)calloc(c->S, sizeof(pressure_t));
+    if(!set) exit(FAIL);
+}
+
+void
+an_access(stats_t* st, uint64_t address)
+{
+    pressure_t* p = &set[SAR(address, target->b) & target->s_mask];
+    region_t*   r = region_of(address);
+    uint64_t    victim;
+    int         dist;
+
+    dist = sd_access(shadow, address);
+    if(dist < 0) cold++;
+    else reuse[bucket(dist)]++;
+
+    p->access++;
+    if(cache_lookup(target, address)) {
+        st->hit++;
+        r->hit++;
+        return;
+    }
+
+    st->miss++;
+    r->miss++;
+    p->miss++;
+    if(dist < 0) {
+        compulsory++;
+        r->compulsory++;
+    }
+    else if(dist >= lines) {
+        capacity++;
+        r->capacity++;
+    }
+    else {
+        conflict++;
+        r->conflict++;
+        p->conflict++;
+    }
+
+    if(cache_fill(target, address, &victim, NULL)) {
+        st->evict++;
+        p->evict++;
+        region_of(victim)->evicted++;
+    }
+}
+
+static int
+by_region_misses(const void* x, const void* y)
+{
+    const region_t* a = (const region_t*)x;
+    const region_t* b = (const region_t*)y;
+
+    if(a->miss != b->miss) return a->miss < b->miss ? 1 : -1;
+    return a->base < b->base ? -1 : a->base > b->base;
+}
+
+static int
+by_set_conflicts(const void* x, const void* y)
+{
+    const pressure_t*   a = &set[*(const int*)x];
+    const pressure_t*   b = &set[*(const int*)y];
+
+    if(a->conflict != b->conflict) return a->conflict < b->conflict ? 1 : -1;
+    if(a->miss != b->miss) return a->miss < b->miss ? 1 : -1;
+    return *(const int*)x - *(const int*)y;
+}
+
+// prints the buckets up to the last one in use
+static void
+print_buckets(FILE* out, const int64_t* count, const char* what)
+{
+    int     n = BUCKETS;
+
+    while(n > 0 && !count[n - 1]) n--;
+    fprintf(out, "[");
+    for(int k=0; k<n; k++) {
+        fprintf(out, "%s\n      {\"min\": %llu, \"max\": %llu, \"%s\": %ld}",
+                k ? "," : "",
+                k ? 1ULL << (k - 1) : 0ULL,
+                k ? (k == 64 ? ~0ULL : (1ULL << k) - 1) : 0ULL,
+                what, (long)count[k]);
+    }
+    fprintf(out, "%s]", n ? "\n    " : "");
+}
+
+void
+an_report(FILE* out, const stats_t* st)
+{
+    int64_t     evict_hist[BUCKETS];
+    int*        order;
+    int         top;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"cache\": {\"s\": %d, \"E\": %d, \"b\": %d, \"policy\": \"%s\"},\n",
+            target->s, target->E, target->b, target->policy->name);
+    fprintf(out, "  \"summary\": {\"hits\": %ld, \"misses\": %ld, \"evictions\": %ld},\n",
+            (long)st->hit, (long)st->miss, (long)st->evict);
+    fprintf(out, "  \"misses\": {\"compulsory\": %ld, \"capacity\": %ld, \"conflict\": %ld},\n",
+            (long)compulsory, (long)capacity, (long)conflict);
+
+    fprintf(out, "  \"reuse_distance\": {\n    \"cold\": %ld,\n    \"buckets\": ",
+            (long)cold);
+    print_buckets(out, reuse, "accesses");
+    fprintf(out, "\n  },\n");
+
+    qsort(region, nregions, sizeof(region_t), by_region_misses);
+    top = nregions < ANALYZE_TOP ? (int)nregions : ANALYZE_TOP;
+    fprintf(out, "  \"regions\": {\n    \"bits\": %d,\n    \"count\": %lu,\n    \"top\": [",
+            region_bits, (unsigned long)nregions);
+    for(int i=0; i<top; i++) {
+        region_t*   r = &region[i];
+
+        fprintf(out, "%s\n      {\"base\": \"0x%llx\", \"hits\": %ld, \"misses\": %ld, "
+                "\"compulsory\": %ld, \"capacity\": %ld, \"conflict\": %ld, \"evicted\": %ld}",
+                i ? "," : "", (unsigned long long)SHL(r->base, region_bits),
+                (long)r->hit, (long)r->miss, (long)r->compulsory, (long)r->capacity,
+                (long)r->conflict, (long)r->evicted);
+    }
+    fprintf(out, "%s]\n  },\n", top ? "\n    " : "");
+
+    memset(evict_hist, 0, sizeof(evict_hist));
+    order = (int*)malloc(sizeof(int) * target->S);
+    if(!order) exit(FAIL);
+    for(int i=0; i<target->S; i++) {
+        evict_hist[bucket(set[i].evict)]++;
+        order[i] = i;
+    }
+    qsort(order, target->S, sizeof(int), by_set_conflicts);
+    top = target->S < ANALYZE_TOP ? target->S : ANALYZE_TOP;
+    fprintf(out, "  \"sets\": {\n    \"count\": %d,\n    \"evictions\": ", target->S);
+    print_buckets(out, evict_hist, "sets");
+    fprintf(out, ",\n    \"top\": [");
+    for(int i=0; i<top; i++) {
+        pressure_t* p = &set[order[i]];
+
+        fprintf(out, "%s\n      {\"set\": %d, \"accesses\": %ld, \"misses\": %ld, "
+                "\"evictions\": %ld, \"conflict\": %ld}",
+                i ? "," : "", order[i], (long)p->access, (long)p->miss,
+                (long)p->evict, (long)p->conflict);
+    }
+    fprintf(out, "%s]\n  }\n}\n", top ? "\n    " : "");
+
+    free(order);
+    free(set);
+    free(region);
+    free(rkey);
+    free(rval);
+    sd_free(shadow);
+}
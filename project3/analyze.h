@@ -0,0 +1,19 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "cache.h"
+
+#include <stdio.h>
+
+#define ANALYZE_TOP     (64)    // regions and sets listed in the report
+
+// attributes the accesses of c to regions of 2^region_bits bytes
+void    an_init(cache_t* c, int region_bits);
+
+// one access, counted in st as well
+void    an_access(stats_t* st, uint64_t address);
+
+// writes the analysis of the accesses so far as JSON
+void    an_report(FILE* out, const stats_t* st);
+
+#endif
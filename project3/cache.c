@@ -1,158 +1,421 @@
 #include "cachelab.h"
+#include "cache.h"
+#include "trace.h"
+#include "sweep.h"
+#include "shard.h"
+#include "hier.h"
+#include "coher.h"
+#include "prefetch.h"
+#include "analyze.h"
+#include "opt.h"
+#include "tlb.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
 #include <getopt.h>
+#include <immintrin.h>
 
 #define SUCCESS     (0)
 #define FAIL        (1)
 #define SAR(X, Y)   ((X) >> (Y))
 #define SHL(X, Y)   ((X) << (Y))
 
-typedef unsigned long lru_t;
-
-// line_t structure
-typedef struct line_t {
-    bool    valid;
-    int     tag;
-    lru_t   lru;
-} line_t;
-typedef line_t* set_t;
-typedef set_t*  cache_t;
+#define TAG_LANES   (4)             // 64-bit tags per AVX2 compare
+#define TAG_INVALID (UINT64_MAX)    // never a real tag since b >= 1, so
+                                    // it also marks holes
 
 // global variable
 int         s, b;
 int         S, B, E;
-size_t      s_mask;
-size_t      t_mask;
-int64_t     miss = 0;
-int64_t     hit = 0;
-int64_t     evict = 0;
+stats_t     total;
 cache_t     cache;
 char*       trace_loc;
-FILE*       trace_file;
+int         threads = 1;    // -p: simulate sets on this many threads
+bool        sweep;          // -r: -s, -E and -b are lists such as 1,2,4-8
+char*       s_arg;
+char*       E_arg;
+char*       b_arg;
+bool        hier;           // -l: simulate the hierarchy given by -l specs
+int         mem_latency = 100;
+const policy_t* policy;     // -P: replacement policy, LRU by default
+uint32_t    seed = 1;       // -R: seed of the random policies
+bool        writes;         // -w, -n: model stores, dirty lines and traffic
+bool        write_through;  // -w wt, else write-back
+bool        write_allocate = true;  // cleared by -n
+bool        coherent;       // -c: one core per -c trace, kept coherent
+int         protocol = PROTO_MESI;  // -C mesi|moesi
+int         network = NET_BUS;      // -D: directory instead of a bus
+bool        prefetching;    // -f: prefetchers
+int         pf_delay;       // -d: accesses until a prefetch arrives
+char*       json_loc;       // -j: write the miss analysis here, - for stdout
+int         region_bits = 12;   // -g: bytes per analysed region, log2
+int         sample = 1;     // -k: simulate every sample-th set only
+int         sample_bits;
+int64_t*    set_access;     // per sampled set
+int64_t*    set_miss;
+bool        optimal;        // -O: report Belady's MIN counts as well
+stats_t     best;
+bool        translating;    // -T: put the TLB levels given by -T specs in front
+bool        walk_inject;    // -W: send page-walk references through the cache
+bool        paged;          // -z: the page size of the TLB levels is given
+
+int
+find_tag_scalar(const uint64_t* set, uint64_t tag, int used)
+{
+    for(int j=0; j<used; j++) {
+        if(set[j] == tag) return j;
+    }
+    return -1;
+}
+
+// compares TAG_LANES ways per step; the padding ways hold TAG_INVALID,
+// so the last step needs no mask.
+__attribute__((target("avx2"))) int
+find_tag_avx2(const uint64_t* set, uint64_t tag, int used)
+{
+    __m256i     key;
+    __m256i     ways;
+    int         mask;
+
+    key = _mm256_set1_epi64x((long long)tag);
+    for(int j=0; j<used; j+=TAG_LANES) {
+        ways = _mm256_load_si256((const __m256i*)(set + j));
+        mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(ways, key)));
+        if(mask) return j + __builtin_ctz(mask);
+    }
+    return -1;
+}
+
+bool 
+cache_new(cache_t* c, int s, int E, int b, const policy_t* policy, uint32_t seed) 
+{
+    size_t  ways;
+    size_t  size;
+
+    c->s = s;
+    c->b = b;
+    c->E = E;
+    c->S = SHL(1, s);
+    c->W = (E + TAG_LANES - 1) / TAG_LANES * TAG_LANES;
+    ways = (size_t)c->S * c->W;
+    size = ways * (sizeof(uint64_t) + 1) + sizeof(set_hdr_t) * c->S;
+    size = (size + 31) / 32 * 32;
+    c->mem = aligned_alloc(32, size);
+    if(!c->mem) exit(FAIL);
+    c->tags = (uint64_t*)c->mem;
+    c->hdr = (set_hdr_t*)(c->tags + ways);
+    c->state = (uint8_t*)(c->hdr + c->S);
+
+    for(size_t i=0; i<ways; i++) c->tags[i] = TAG_INVALID;
+    memset(c->hdr, 0, sizeof(set_hdr_t) * c->S);
+    memset(c->state, 0, ways);
+    c->s_mask = (uint64_t)c->S - 1;
+
+    // a scan of one or two ways is cheaper than setting up a vector
+    __builtin_cpu_init();
+    if(E > 2 && __builtin_cpu_supports("avx2")) c->find_tag = find_tag_avx2;
+    else c->find_tag = find_tag_scalar;
+
+    c->policy = policy ? policy : policy_find("lru");
+    c->meta = NULL;
+    c->seed = seed;
+    return c->policy->init(c);
+}
+
+void 
+cache_free(cache_t* c) 
+{
+    free(c->mem);
+    free(c->meta);
+}
+
+// returns the way holding the block of address in set *index, or -1
+static inline int
+find_way(cache_t* c, uint64_t address, size_t* index)
+{
+    uint64_t    tag;
+
+    *index = SAR(address, c->b) & c->s_mask;
+    tag = c->s + c->b < 64 ? SAR(address, c->s+c->b) : 0;
+    return c->find_tag(c->tags + *index * c->W, tag, c->hdr[*index].used);
+}
+
+// looks address up and tells the policy about a hit.
+bool 
+cache_lookup(cache_t* c, uint64_t address) 
+{
+    size_t      index;
+    int         j;
+
+    j = find_way(c, address, &index);
+    if(j < 0) return false;
+    c->policy->hit(c, index, j);
+    return true;
+}
+
+// cache_lookup for a write, which makes a hit line dirty.
+bool 
+cache_write(cache_t* c, uint64_t address) 
+{
+    size_t      index;
+    int         j;
+
+    j = find_way(c, address, &index);
+    if(j < 0) return false;
+    c->policy->hit(c, index, j);
+    c->state[index * c->W + j] = LINE_DIRTY;
+    return true;
+}
 
+// the state byte of the line holding address, -1 if it is not cached.
+// the replacement policy does not see this.
 int 
-find_lru(size_t index) 
+cache_state(cache_t* c, uint64_t address) 
 {
-    lru_t   max_lru;
-    int     max_j;
+    size_t      index;
+    int         j;
 
-    max_lru = 0;
-    max_j = 0;
-    for(int j=0; j<E; j++) {
-        if(max_lru <= cache[index][j].lru) {
-            max_lru = cache[index][j].lru;
-            max_j = j;
-        }
+    j = find_way(c, address, &index);
+    return j < 0 ? -1 : c->state[index * c->W + j];
+}
+
+void 
+cache_set_state(cache_t* c, uint64_t address, int state) 
+{
+    size_t      index;
+    int         j;
+
+    j = find_way(c, address, &index);
+    if(j >= 0) c->state[index * c->W + j] = (uint8_t)state;
+}
+
+// installs the block of address, which must not be cached, as a line in
+// state 0 in a free way or in place of the policy's victim; returns true
+// with the address and the state of the evicted line in *victim and
+// *state if the set was full.
+bool 
+cache_fill(cache_t* c, uint64_t address, uint64_t* victim, uint8_t* state) 
+{
+    size_t      index;
+    uint64_t    tag;
+    uint64_t*   set;
+    set_hdr_t*  hdr;
+    int         j;
+
+    index = SAR(address, c->b) & c->s_mask;
+    tag = c->s + c->b < 64 ? SAR(address, c->s+c->b) : 0;
+    set = c->tags + index * c->W;
+    hdr = &c->hdr[index];
+
+    // do not need eviction.
+    if(hdr->valid < c->E) {
+        if(hdr->valid < hdr->used) j = c->find_tag(set, TAG_INVALID, hdr->used);
+        else j = hdr->used++;
+        hdr->valid++;
+        set[j] = tag;
+        c->state[index * c->W + j] = 0;
+        c->policy->fill(c, index, j);
+
+        return false;
     }
-    return max_j;
+
+    // need eviction.
+    j = c->policy->victim(c, index);
+    c->policy->invalidate(c, index, j);
+    if(victim) *victim = SHL(set[j], c->s+c->b) | SHL((uint64_t)index, c->b);
+    if(state) *state = c->state[index * c->W + j];
+    set[j] = tag;
+    c->state[index * c->W + j] = 0;
+    c->policy->fill(c, index, j);
+    return true;
+}
+
+// drops the block of address if it is cached, leaving a hole for the
+// next fill of the set.
+bool 
+cache_invalidate(cache_t* c, uint64_t address) 
+{
+    size_t      index;
+    int         j;
+
+    j = find_way(c, address, &index);
+    if(j < 0) return false;
+
+    c->policy->invalidate(c, index, j);
+    c->tags[index * c->W + j] = TAG_INVALID;
+    c->hdr[index].valid--;
+    return true;
 }
 
 void 
 cache_init() 
 {
-    size_t          st_part;
-    unsigned long   full;
-    
     if(!S || !E || !B) exit(EXIT_FAILURE);
-
-    cache = (set_t*)malloc(sizeof(set_t) * S);
-    if(!cache) exit(FAIL);
-    for(int i=0; i<S; i++) {
-        cache[i] = (line_t*)malloc(sizeof(line_t) * E);
-        if(!cache[i]) exit(FAIL);
-        for(int j=0; j<E; j++) {
-            cache[i][j].valid = 0;
-            cache[i][j].tag = 0;
-            cache[i][j].lru = 0;
-        }
-    }
-    full = 0xffffffff;
-    t_mask = SHL(SAR(full, s+b), s+b);
-    st_part = SHL(SAR(full, b), b);
-    s_mask = t_mask ^ st_part;
+    if(!cache_new(&cache, s - sample_bits, E, b, policy, seed)) exit(EXIT_FAILURE);
 }
 
 void 
 cache_destroy() 
 {
-    for(int i=0; i<S; i++) free(cache[i]);
-    free(cache);
+    cache_free(&cache);
 }
 
 void 
-cache_simulate(size_t address) 
+cache_simulate(stats_t* st, uint64_t address) 
 {
-    size_t      index;
-    size_t      tag;
-    size_t      lru;
-    int         j;
-    int         empty_j;
-    bool        flag;
-
-    index = SAR(address&s_mask, b);
-    tag = SAR(address&t_mask, s+b);
-    empty_j = -1;
-    flag = 0;
-
-    // hit?    
-    for(j=0; j<E; j++) {
-        if(!cache[index][j].valid) {
-            if(empty_j < 0) empty_j = j;
-            continue;
+    // hit!
+    if(cache_lookup(&cache, address)) {
+        st->hit++;
+        return;
+    }
+
+    st->miss++;
+    if(cache_fill(&cache, address, NULL, NULL)) st->evict++;
+}
+
+// the len bytes at address, all in one block, in the write model
+static void 
+block_access(stats_t* st, uint64_t address, int len, bool write) 
+{
+    uint8_t dirty;
+    bool    hit;
+
+    if(!write) hit = cache_lookup(&cache, address);
+    else if(write_through) hit = cache_lookup(&cache, address);
+    else hit = cache_write(&cache, address);
+
+    if(hit) st->hit++;
+    else {
+        st->miss++;
+        // the store goes around the cache
+        if(write && !write_allocate) {
+            st->mem_write++;
+            st->bytes_written += len;
+            return;
         }
-        if(tag == cache[index][j].tag) {
-            flag = 1;
-            cache[index][j].lru = 0;
+        st->mem_read++;
+        st->bytes_read += B;
+        if(cache_fill(&cache, address, NULL, &dirty)) {
+            st->evict++;
+            if(dirty) {
+                st->dirty_evict++;
+                st->mem_write++;
+                st->bytes_written += B;
+            }
         }
-        else cache[index][j].lru++;
+        // the policy saw the fill; a hit now would count a reuse
+        if(write && !write_through) cache_set_state(&cache, address, LINE_DIRTY);
     }
+    if(write && write_through) {
+        st->mem_write++;
+        st->bytes_written += len;
+    }
+}
 
-    // hit!
-    if(flag) { 
-        hit++;
-        return;
+// every block of [address, address+size)
+static void 
+span_access(stats_t* st, uint64_t address, uint32_t size, bool write) 
+{
+    uint64_t    end = address + (size ? size : 1);
+    uint64_t    next;
+
+    for(; address<end; address=next) {
+        next = SHL(SAR(address, b) + 1, b);
+        if(next > end) next = end;
+        block_access(st, address, (int)(next - address), write);
     }
+}
 
-    miss++;
-    // do not need eviction.
-    if(empty_j >= 0) { 
-        cache[index][empty_j].valid = 1;
-        cache[index][empty_j].lru = 0;
-        cache[index][empty_j].tag = tag;
+// one access of the trace with its size and kind: a load, a store, or a
+// load and then a store for 'M'. lines dirtied by stores are written back
+// when they are evicted; the ones still dirty at the end are not counted.
+void 
+cache_simulate_write(stats_t* st, const access_t* a) 
+{
+    if(a->op != 'S') span_access(st, a->addr, a->size, false);
+    if(a->op != 'L') span_access(st, a->addr, a->size, true);
+}
 
-        return;
+// set sampling: only the sets whose index is a multiple of sample are
+// simulated, in a cache of S/sample sets. the index of an address in
+// such a set ends in sample_bits zeros, which are dropped so that the
+// set is found in the smaller cache with the same tag.
+void 
+sample_simulate(stats_t* st, uint64_t address) 
+{
+    uint64_t    block = SAR(address, b);
+    int64_t     miss = st->miss;
+    size_t      set;
+
+    if(block & (sample - 1)) return;
+    block = SAR(block, sample_bits);
+    set = block & cache.s_mask;
+    cache_simulate(st, SHL(block, b));
+    set_access[set]++;
+    set_miss[set] += st->miss - miss;
+}
+
+// scales the counts of the sampled sets up to all sets and prints them
+// with 95% confidence bounds for the miss rate, a ratio estimate over
+// the sampled sets, and for the number of misses.
+void 
+sample_report(const stats_t* st) 
+{
+    int         m = cache.S;
+    double      f = 1.0 / sample;
+    double      accesses = 0;
+    double      misses = 0;
+    double      rate;
+    double      dev_m = 0;
+    double      dev_r = 0;
+
+    for(int i=0; i<m; i++) {
+        accesses += set_access[i];
+        misses += set_miss[i];
     }
+    rate = accesses ? misses / accesses : 0;
+    for(int i=0; i<m; i++) {
+        dev_m += (set_miss[i] - misses / m) * (set_miss[i] - misses / m);
+        dev_r += (set_miss[i] - rate * set_access[i]) * (set_miss[i] - rate * set_access[i]);
+    }
+    dev_m = S * sqrt(dev_m / (m - 1) / m * (1 - f));
+    dev_r = accesses ? sqrt(dev_r / (m - 1) / m * (1 - f)) / (accesses / m) : 0;
 
-    // need eviction.
-    lru = find_lru(index);
-    cache[index][lru].lru = 0;
-    cache[index][lru].tag = tag;
-    evict++;
+    printSummary(st->hit * sample, st->miss * sample, st->evict * sample);
+    printf("sampled %d of %d sets: miss-rate:%.6f +-%.6f misses:%.0f +-%.0f "
+           "(95%% confidence)\n",
+           m, S, rate, 1.96 * dev_r, misses * sample, 1.96 * dev_m);
 }
 
 int main(int argc, char *argv[]) 
 {
     char            op;
-    char            query;
-    int             size;
-    unsigned long   adr;
+    access_t*       batch;
+    uint64_t        pc = 0;
+    FILE*           json;
+    int             n;
+    int             sv[SWEEP_MAX], ev[SWEEP_MAX], bv[SWEEP_MAX];
+    int             ns, ne, nb;
 
-    while((op = getopt(argc, argv, "s:E:b:t:")) != -1) {
+    while((op = getopt(argc, argv, "s:E:b:t:rp:l:m:P:R:w:nc:C:Df:d:j:g:k:OT:z:W")) != -1) {
         switch(op) {
             case 's':
+                s_arg = optarg;
                 s = atoi(optarg);
-                if(!s) return FAIL;
+                if(s < 0) return FAIL;
                 S = SHL(1, s);
                 break;
             case 'E':
+                E_arg = optarg;
                 E = atoi(optarg);
                 if(!E) return FAIL;
                 break;
             case 'b':
+                b_arg = optarg;
                 b = atoi(optarg);
                 if(!b) return FAIL;
                 B = SHL(1, b);
@@ -161,28 +424,255 @@ int main(int argc, char *argv[])
                 trace_loc = optarg;
                 if(!trace_loc) return FAIL;
                 break;
+            case 'r':
+                sweep = 1;
+                break;
+            case 'p':
+                threads = atoi(optarg);
+                if(threads < 1 || threads > SHARD_MAX) return FAIL;
+                break;
+            case 'l':
+                if(hier_add(optarg) != SUCCESS) return FAIL;
+                hier = 1;
+                break;
+            case 'm':
+                mem_latency = atoi(optarg);
+                if(mem_latency < 0) return FAIL;
+                break;
+            case 'P':
+                policy = policy_find(optarg);
+                if(!policy) return FAIL;
+                break;
+            case 'R':
+                seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                if(!strcmp(optarg, "wt")) write_through = 1;
+                else if(strcmp(optarg, "wb")) return FAIL;
+                writes = 1;
+                break;
+            case 'n':
+                write_allocate = 0;
+                writes = 1;
+                break;
+            case 'c':
+                if(coher_add(optarg) != SUCCESS) return FAIL;
+                coherent = 1;
+                break;
+            case 'C':
+                if(!strcmp(optarg, "mesi")) protocol = PROTO_MESI;
+                else if(!strcmp(optarg, "moesi")) protocol = PROTO_MOESI;
+                else return FAIL;
+                break;
+            case 'D':
+                network = NET_DIR;
+                break;
+            case 'f':
+                if(pf_parse(optarg) != SUCCESS) return FAIL;
+                prefetching = 1;
+                break;
+            case 'd':
+                pf_delay = atoi(optarg);
+                if(pf_delay < 0) return FAIL;
+                break;
+            case 'j':
+                json_loc = optarg;
+                break;
+            case 'g':
+                region_bits = atoi(optarg);
+                if(region_bits < 0 || region_bits > 63) return FAIL;
+                break;
+            case 'k':
+                sample = atoi(optarg);
+                if(sample < 1 || (sample & (sample - 1))) return FAIL;
+                sample_bits = __builtin_ctz(sample);
+                break;
+            case 'O':
+                optimal = 1;
+                break;
+            case 'T':
+                if(tlb_add(optarg) != SUCCESS) return FAIL;
+                translating = 1;
+                break;
+            case 'z':
+                if(tlb_page(optarg) != SUCCESS) return FAIL;
+                paged = 1;
+                break;
+            case 'W':
+                walk_inject = 1;
+                break;
             default:
                 return FAIL;
         }
     }
 
+    // the write model runs on the single cache, on one thread: the shard
+    // queues carry bare addresses
+    if(writes && (hier || sweep || threads > 1)) return FAIL;
+    // so do the prefetchers, whose tables see every set
+    if(prefetching && (writes || hier || sweep || coherent || threads > 1)) return FAIL;
+    // and the analysis, which shadows all of them
+    if(json_loc && (prefetching || writes || hier || sweep || coherent || threads > 1))
+        return FAIL;
+    // sampling needs two sets at least for its error bounds
+    if(sample > 1 && (json_loc || prefetching || writes || hier || sweep || coherent
+                      || threads > 1 || S < 2 * sample))
+        return FAIL;
+    // MIN replays the accesses of the plain single cache in trace order
+    if(optimal && (sample > 1 || json_loc || prefetching || writes || hier || sweep
+                   || coherent || threads > 1))
+        return FAIL;
+    // translation stands in front of the plain single cache only
+    if((walk_inject || paged) && !translating) return FAIL;
+    if(translating && (optimal || sample > 1 || json_loc || prefetching || writes || hier
+                       || sweep || coherent || threads > 1))
+        return FAIL;
+
+    if(coherent) {
+        if(writes || hier || sweep || !S || !E || !B) return FAIL;
+        coher_run(protocol, network, policy, seed);
+        return SUCCESS;
+    }
+
+    if(hier) {
+        if(trace_open(trace_loc, threads) != SUCCESS) exit(EXIT_FAILURE);
+        hier_run(mem_latency, policy, seed);
+        trace_close();
+        return SUCCESS;
+    }
+
+    if(sweep) {
+        // stack distances only describe LRU
+        if(policy && strcmp(policy->name, "lru")) return FAIL;
+        if(!s_arg || !E_arg || !b_arg) return FAIL;
+        ns = sweep_parse(s_arg, sv);
+        ne = sweep_parse(E_arg, ev);
+        nb = sweep_parse(b_arg, bv);
+        if(ns <= 0 || ne <= 0 || nb <= 0) return FAIL;
+        for(int i=0; i<ns; i++) if(sv[i] < 0 || sv[i] > 30) return FAIL;
+        for(int i=0; i<ne; i++) if(ev[i] < 1) return FAIL;
+        for(int i=0; i<nb; i++) if(bv[i] < 1 || bv[i] > 62) return FAIL;
+
+        if(trace_open(trace_loc, threads) != SUCCESS) exit(EXIT_FAILURE);
+        sweep_run(sv, ns, ev, ne, bv, nb);
+        trace_close();
+        return SUCCESS;
+    }
+
     // test body
     cache_init();
 
-    trace_file = fopen(trace_loc, "r");
-    if(!trace_file) exit(EXIT_FAILURE);
+    if(trace_open(trace_loc, threads) != SUCCESS) exit(EXIT_FAILURE);
 
-    while (fscanf(trace_file, " %c %lx,%d", &query, &adr, &size) == 3) {
-        if(query=='I') continue;
-        cache_simulate(adr);
-        if(query=='M') cache_simulate(adr);
+    // sets of a policy with shared state cannot be simulated apart
+    if(threads > 1 && cache.policy->shared) return FAIL;
+    if(threads > 1) shard_run(threads, &total);
+    else if(sample > 1) {
+        set_access = (int64_t*)calloc(cache.S, sizeof(int64_t));
+        set_miss = (int64_t*)calloc(cache.S, sizeof(int64_t));
+        if(!set_access || !set_miss) exit(EXIT_FAILURE);
+        while ((n = trace_read(&batch)) > 0) {
+            for(int i=0; i<n; i++) {
+                if(batch[i].op=='I') continue;
+                sample_simulate(&total, batch[i].addr);
+                if(batch[i].op=='M') sample_simulate(&total, batch[i].addr);
+            }
+        }
+    }
+    else if(json_loc) {
+        an_init(&cache, region_bits);
+        while ((n = trace_read(&batch)) > 0) {
+            for(int i=0; i<n; i++) {
+                if(batch[i].op=='I') continue;
+                an_access(&total, batch[i].addr);
+                if(batch[i].op=='M') an_access(&total, batch[i].addr);
+            }
+        }
+    }
+    else if(prefetching) {
+        // the last instruction fetch gives the PC of a data access
+        pf_init(&cache, pf_delay);
+        while ((n = trace_read(&batch)) > 0) {
+            for(int i=0; i<n; i++) {
+                if(batch[i].op=='I') {
+                    pc = batch[i].addr;
+                    continue;
+                }
+                pf_access(&total, pc, batch[i].addr);
+                if(batch[i].op=='M') pf_access(&total, pc, batch[i].addr);
+            }
+        }
+    }
+    else if(optimal) {
+        opt_init(&cache);
+        while ((n = trace_read(&batch)) > 0) {
+            for(int i=0; i<n; i++) {
+                if(batch[i].op=='I') continue;
+                cache_simulate(&total, batch[i].addr);
+                opt_record(batch[i].addr);
+                if(batch[i].op=='M') {
+                    cache_simulate(&total, batch[i].addr);
+                    opt_record(batch[i].addr);
+                }
+            }
+        }
+        opt_run(&best);
+    }
+    else if(translating) {
+        tlb_init(&cache, walk_inject);
+        while ((n = trace_read(&batch)) > 0) {
+            for(int i=0; i<n; i++) {
+                if(batch[i].op=='I') continue;
+                tlb_access(batch[i].addr);
+                cache_simulate(&total, batch[i].addr);
+                if(batch[i].op=='M') {
+                    tlb_access(batch[i].addr);
+                    cache_simulate(&total, batch[i].addr);
+                }
+            }
+        }
+    }
+    else {
+        while ((n = trace_read(&batch)) > 0) {
+            for(int i=0; i<n; i++) {
+                if(batch[i].op=='I') continue;
+                if(writes) {
+                    cache_simulate_write(&total, &batch[i]);
+                    continue;
+                }
+                cache_simulate(&total, batch[i].addr);
+                if(batch[i].op=='M') cache_simulate(&total, batch[i].addr);
+            }
+        }
     }
 
-    printSummary(hit, miss, evict);
+    if(sample > 1) sample_report(&total);
+    // a report on stdout holds the summary itself and must stay valid JSON
+    else if(!json_loc || strcmp(json_loc, "-"))
+        printSummary(total.hit, total.miss, total.evict);
+    if(optimal) {
+        printf("optimal hits:%ld misses:%ld evictions:%ld (%s misses %.3fx)\n",
+               (long)best.hit, (long)best.miss, (long)best.evict, cache.policy->name,
+               best.miss ? (double)total.miss / best.miss : 1.0);
+    }
+    if(translating) tlb_report();
+    if(prefetching) pf_report(&total);
+    if(json_loc) {
+        json = strcmp(json_loc, "-") ? fopen(json_loc, "w") : stdout;
+        if(!json) exit(EXIT_FAILURE);
+        an_report(json, &total);
+        if(json != stdout) fclose(json);
+    }
+    if(writes) {
+        printf("dirty-evictions:%ld memory-reads:%ld memory-writes:%ld "
+               "bytes-read:%ld bytes-written:%ld\n",
+               (long)total.dirty_evict, (long)total.mem_read, (long)total.mem_write,
+               (long)total.bytes_read, (long)total.bytes_written);
+    }
 
     cache_destroy();
-    fclose(trace_file);
+    trace_close();
 
     // test end
     return SUCCESS;
-}
\ No newline at end of file
+}
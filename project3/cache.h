@@ -0,0 +1,89 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "trace.h"
+
+// access counters; each shard of a parallel run keeps its own
+typedef struct stats_t {
+    int64_t     hit;
+    int64_t     miss;
+    int64_t     evict;
+    // write model only
+    int64_t     dirty_evict;
+    int64_t     mem_read;       // blocks read from memory
+    int64_t     mem_write;      // writebacks and stores sent to memory
+    int64_t     bytes_read;
+    int64_t     bytes_written;
+} stats_t;
+
+// fill state of each set. ways are taken in order, and an invalidated
+// way stays a hole holding TAG_INVALID until a later fill reuses it.
+typedef struct set_hdr_t {
+    int     used;   // ways used..W-1 were never filled
+    int     valid;
+} set_hdr_t;
+
+#define LINE_DIRTY      (1)     // state of a written line in the write model
+#define LINE_PREFETCHED (2)     // prefetched and not used yet
+
+typedef struct cache_t  cache_t;
+
+// replacement policy. fill is called for every installed block, after
+// invalidate on the victim when the set was full; hit for every lookup
+// that finds its block. victim is only asked for full sets.
+typedef struct policy_t {
+    const char* name;
+    bool        (*init)(cache_t* c);    // false if the geometry is unsupported
+    void        (*hit)(cache_t* c, size_t index, int j);
+    void        (*fill)(cache_t* c, size_t index, int j);
+    int         (*victim)(cache_t* c, size_t index);
+    void        (*invalidate)(cache_t* c, size_t index, int j);
+    bool        shared;                 // keeps state across sets
+} policy_t;
+
+// one cache. layout: one allocation holding the tags set after set,
+// followed by the set headers and a state byte per line; the policy
+// allocates its own metadata.
+struct cache_t {
+    int             s, b, E;
+    int             S;
+    int             W;              // ways per set rounded up to TAG_LANES
+    uint64_t        s_mask;
+    void*           mem;
+    uint64_t*       tags;           // S * W
+    set_hdr_t*      hdr;            // S
+    uint8_t*        state;          // S * W, LINE_DIRTY or coherence state
+    int             (*find_tag)(const uint64_t*, uint64_t, int);
+    const policy_t* policy;
+    void*           meta;
+    uint32_t        seed;           // of the random policies
+    int             psel;           // set dueling counter of DRRIP
+};
+
+extern int      s, b;
+extern int      S, B, E;
+
+bool    cache_new(cache_t* c, int s, int E, int b,
+                  const policy_t* policy, uint32_t seed);
+void    cache_free(cache_t* c);
+bool    cache_lookup(cache_t* c, uint64_t address);
+bool    cache_write(cache_t* c, uint64_t address);
+bool    cache_fill(cache_t* c, uint64_t address, uint64_t* victim, uint8_t* state);
+int     cache_state(cache_t* c, uint64_t address);
+void    cache_set_state(cache_t* c, uint64_t address, int state);
+bool    cache_invalidate(cache_t* c, uint64_t address);
+
+// the single cache of the default mode
+void    cache_init();
+void    cache_destroy();
+void    cache_simulate(stats_t* st, uint64_t address);
+void    cache_simulate_write(stats_t* st, const access_t* a);
+
+// policy.c; NULL if there is no policy of that name
+const policy_t* policy_find(const char* name);
+
+#endif
@@ -0,0 +1,463 @@
+#include "coher.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SUCCESS     (0)
+#define FAIL        (1)
+#define SAR(X, Y)   ((X) >> (Y))
+#define SHL(X, Y)   ((X) << (Y))
+
+#define NO_BLOCK    (UINT64_MAX)    // empty hash slot
+
+// multi-core coherence.
+//
+// every core has a private cache of the same geometry, and the state
+// byte of a line holds its MESI or MOESI state. the cores take turns, one
+// trace line each, and every request completes before the next one, as
+// on an atomic bus. a read miss finds the block in E, S or I; a dirty
+// copy elsewhere supplies the data and becomes S under MESI, writing the
+// block back, or O under MOESI. an E copy also supplies it and becomes S.
+// a write miss or a write to an S or O line invalidates all other copies.
+//
+// the protocol is the same on both interconnects; they only differ in
+// what the requests cost. a bus broadcasts every request to all other
+// caches. the directory knows the exact sharers, since even clean
+// evictions notify it, and sends invalidations and forwards to them only.
+//
+// a miss is a coherence miss when another core's write invalidated the
+// block in this cache. it is true sharing if the access touches a byte
+// written by another core since then, and false sharing otherwise; the
+// bytes are tracked with a 64-bit mask per block, so blocks over 64
+// bytes are tracked in 64 parts.
+
+enum { ST_I, ST_S, ST_E, ST_O, ST_M };
+
+static const char*  proto_name[] = { "MESI", "MOESI" };
+
+// block -> bytes written by other cores since this core lost the block
+typedef struct lost_t {
+    uint64_t*   key;
+    uint64_t*   mask;
+    size_t      cap;
+    size_t      used;
+} lost_t;
+
+typedef struct core_t {
+    const char* path;
+    access_t*   trace;
+    size_t      n;
+    size_t      cap;
+    cache_t     c;
+    lost_t      lost;
+    int64_t     hit;
+    int64_t     miss;
+    int64_t     coher_miss;
+    int64_t     true_share;
+    int64_t     false_share;
+    int64_t     evict;
+    int64_t     writeback;
+    int64_t     upgrade;
+    int64_t     inval_sent;
+    int64_t     inval_recv;
+    int64_t     requests;
+} core_t;
+
+static core_t       core[COHER_MAX];
+static int          ncores;
+static int          proto;
+static int          network;
+static int          grain;          // log2 of the bytes per mask bit
+
+// interconnect
+static int64_t      bus_rd;
+static int64_t      bus_rdx;
+static int64_t      bus_upgr;
+static int64_t      bus_wb;
+static int64_t      snoops;
+static int64_t      msg_req;
+static int64_t      msg_fwd;
+static int64_t      msg_inv;
+static int64_t      msg_ack;
+static int64_t      msg_reply;
+static int64_t      msg_put;
+static int64_t      c2c;
+static int64_t      mem_read;
+static int64_t      mem_write;
+
+int
+coher_add(const char* path)
+{
+    if(ncores == COHER_MAX) return FAIL;
+    core[ncores++].path = path;
+    return SUCCESS;
+}
+
+static inline size_t
+hash_block(uint64_t block, size_t cap)
+{
+    block *= 0x9e3779b97f4a7c15ULL;
+    return (size_t)(block >> 32) & (cap - 1);
+}
+
+// returns the slot of block, or the empty slot where it belongs
+static inline size_t
+lost_find(const lost_t* l, uint64_t block)
+{
+    size_t  h = hash_block(block, l->cap);
+
+    while(l->key[h] != NO_BLOCK && l->key[h] != block)
+        h = (h + 1) & (l->cap - 1);
+    return h;
+}
+
+static void
+lost_grow(lost_t* l)
+{
+    uint64_t*   key = l->key;
+    uint64_t*   mask = l->mask;
+    size_t      cap = l->cap;
+    size_t      h;
+
+    l->cap = cap ? 2 * cap : 1024;
+    l->key = (uint64_t*)malloc(sizeof(uint64_t) * l->cap);
+    l->mask = (uint64_t*)malloc(sizeof(uint64_t) * l->cap);
+    if(!l->key || !l->mask) exit(FAIL);
+    memset(l->key, 0xff, sizeof(uint64_t) * l->cap);
+    for(size_t i=0; i<cap; i++) {
+        if(key[i] == NO_BLOCK) continue;
+        h = lost_find(l, key[i]);
+        l->key[h] = key[i];
+        l->mask[h] = mask[i];
+    }
+    free(key);
+    free(mask);
+}
+
+static void
+lost_add(lost_t* l, uint64_t block, uint64_t mask)
+{
+    size_t  h;
+
+    if(2 * (l->used + 1) > l->cap) lost_grow(l);
+    h = lost_find(l, block);
+    if(l->key[h] == block) {
+        l->mask[h] |= mask;
+        return;
+    }
+    l->key[h] = block;
+    l->mask[h] = mask;
+    l->used++;
+}
+
+// removes block and returns its mask in *mask; false if it is absent
+static bool
+lost_take(lost_t* l, uint64_t block, uint64_t* mask)
+{
+    size_t  h;
+    size_t  i;
+    size_t  home;
+
+    if(!l->used) return false;
+    h = lost_find(l, block);
+    if(l->key[h] != block) return false;
+    *mask = l->mask[h];
+
+    // backward shift: pull up every later entry of the run that may
+    // move into the hole without passing its home slot
+    for(i=(h+1)&(l->cap-1); l->key[i] != NO_BLOCK; i=(i+1)&(l->cap-1)) {
+        home = hash_block(l->key[i], l->cap);
+        if(((i - home) & (l->cap - 1)) >= ((i - h) & (l->cap - 1))) {
+            l->key[h] = l->key[i];
+            l->mask[h] = l->mask[i];
+            h = i;
+        }
+    }
+    l->key[h] = NO_BLOCK;
+    l->used--;
+    return true;
+}
+
+// notes a write of mask in block by core id for the cores that lost it
+static void
+note_write(int id, uint64_t block, uint64_t mask)
+{
+    lost_t*     l;
+    size_t      h;
+
+    for(int k=0; k<ncores; k++) {
+        l = &core[k].lost;
+        if(k == id || !l->used) continue;
+        h = lost_find(l, block);
+        if(l->key[h] == block) l->mask[h] |= mask;
+    }
+}
+
+// invalidates every other copy of the block for a write of mask by id;
+// returns how many there were
+static int
+invalidate_others(int id, uint64_t address, uint64_t mask)
+{
+    int     n = 0;
+
+    for(int k=0; k<ncores; k++) {
+        if(k == id || !cache_invalidate(&core[k].c, address)) continue;
+        core[k].inval_recv++;
+        lost_add(&core[k].lost, SAR(address, b), mask);
+        n++;
+    }
+    core[id].inval_sent += n;
+    return n;
+}
+
+// the core holding the block in M, O or E other than id, or -1
+static int
+owner_of(int id, uint64_t address, int* sharers)
+{
+    int     owner = -1;
+    int     st;
+
+    *sharers = 0;
+    for(int k=0; k<ncores; k++) {
+        if(k == id || (st = cache_state(&core[k].c, address)) < 0) continue;
+        (*sharers)++;
+        if(st != ST_S) owner = k;
+    }
+    return owner;
+}
+
+static void
+request(core_t* me)
+{
+    me->requests++;
+    if(network == NET_BUS) snoops += ncores - 1;
+    else msg_req++;
+}
+
+static void
+read_miss(int id, uint64_t address)
+{
+    core_t*     me = &core[id];
+    int         owner;
+    int         sharers;
+    int         st;
+
+    request(me);
+    bus_rd += network == NET_BUS;
+    owner = owner_of(id, address, &sharers);
+    if(owner >= 0) {
+        c2c++;
+        if(network == NET_DIR) msg_fwd++;
+        st = cache_state(&core[owner].c, address);
+        // MESI has no owned state: the dirty block goes back to memory
+        if(st == ST_M && proto == PROTO_MESI) {
+            mem_write++;
+            bus_wb += network == NET_BUS;
+            if(network == NET_DIR) msg_put++;
+        }
+        if(st == ST_E || (st == ST_M && proto == PROTO_MESI))
+            cache_set_state(&core[owner].c, address, ST_S);
+        else if(st == ST_M)
+            cache_set_state(&core[owner].c, address, ST_O);
+    }
+    else mem_read++;
+    if(network == NET_DIR) msg_reply++;
+    cache_set_state(&me->c, address, sharers ? ST_S : ST_E);
+}
+
+static void
+write_miss(int id, uint64_t address, uint64_t mask)
+{
+    core_t*     me = &core[id];
+    int         owner;
+    int         sharers;
+    int         n;
+
+    request(me);
+    bus_rdx += network == NET_BUS;
+    owner = owner_of(id, address, &sharers);
+    if(owner >= 0) c2c++;
+    else mem_read++;
+    n = invalidate_others(id, address, mask);
+    if(network == NET_DIR) {
+        // the forward to the owner doubles as its invalidation
+        if(owner >= 0) {
+            msg_fwd++;
+            n--;
+        }
+        msg_inv += n;
+        msg_ack += n;
+        msg_reply++;
+    }
+    cache_set_state(&me->c, address, ST_M);
+}
+
+static void
+upgrade(int id, uint64_t address, uint64_t mask)
+{
+    core_t*     me = &core[id];
+    int         n;
+
+    me->upgrade++;
+    request(me);
+    bus_upgr += network == NET_BUS;
+    n = invalidate_others(id, address, mask);
+    if(network == NET_DIR) {
+        msg_inv += n;
+        msg_ack += n;
+        msg_reply++;
+    }
+    cache_set_state(&me->c, address, ST_M);
+}
+
+static void
+fill(int id, uint64_t address)
+{
+    core_t*     me = &core[id];
+    uint64_t    victim;
+    uint8_t     st;
+
+    if(!cache_fill(&me->c, address, &victim, &st)) return;
+    me->evict++;
+    if(network == NET_DIR) msg_put++;
+    if(st == ST_M || st == ST_O) {
+        me->writeback++;
+        mem_write++;
+        bus_wb += network == NET_BUS;
+    }
+}
+
+// the len bytes at address, all in one block, for core id
+static void
+block_access(int id, uint64_t address, int len, bool write)
+{
+    core_t*     me = &core[id];
+    uint64_t    block = SAR(address, b);
+    uint64_t    lo = (address & (B - 1)) >> grain;
+    uint64_t    hi = ((address & (B - 1)) + len - 1) >> grain;
+    uint64_t    mask;
+    uint64_t    lost;
+    int         st;
+
+    mask = (hi - lo == 63 ? ~(uint64_t)0 : SHL((uint64_t)1, hi - lo + 1) - 1) << lo;
+    if(cache_lookup(&me->c, address)) {
+        me->hit++;
+        if(write) {
+            st = cache_state(&me->c, address);
+            if(st == ST_E) cache_set_state(&me->c, address, ST_M);
+            else if(st != ST_M) upgrade(id, address, mask);
+            note_write(id, block, mask);
+        }
+        return;
+    }
+
+    me->miss++;
+    if(lost_take(&me->lost, block, &lost)) {
+        me->coher_miss++;
+        if(lost & mask) me->true_share++;
+        else me->false_share++;
+    }
+    fill(id, address);
+    if(write) {
+        write_miss(id, address, mask);
+        note_write(id, block, mask);
+    }
+    else read_miss(id, address);
+}
+
+// every block of [address, address+size)
+static void
+span_access(int id, uint64_t address, uint32_t size, bool write)
+{
+    uint64_t    end = address + (size ? size : 1);
+    uint64_t    next;
+
+    for(; address<end; address=next) {
+        next = SHL(SAR(address, b) + 1, b);
+        if(next > end) next = end;
+        block_access(id, address, (int)(next - address), write);
+    }
+}
+
+static void
+load(core_t* c)
+{
+    access_t*   batch;
+    int         n;
+
+    if(trace_open(c->path, 1) != SUCCESS) exit(FAIL);
+    while((n = trace_read(&batch)) > 0) {
+        for(int i=0; i<n; i++) {
+            if(batch[i].op=='I') continue;
+            if(c->n == c->cap) {
+                c->cap = c->cap ? 2 * c->cap : 4096;
+                c->trace = (access_t*)realloc(c->trace, sizeof(access_t) * c->cap);
+                if(!c->trace) exit(FAIL);
+            }
+            c->trace[c->n++] = batch[i];
+        }
+    }
+    trace_close();
+}
+
+void
+coher_run(int protocol, int net, const policy_t* policy, uint32_t seed)
+{
+    core_t*     c;
+    access_t*   a;
+    size_t      longest;
+
+    proto = protocol;
+    network = net;
+    grain = b > 6 ? b - 6 : 0;
+    longest = 0;
+    for(int k=0; k<ncores; k++) {
+        c = &core[k];
+        load(c);
+        if(c->n > longest) longest = c->n;
+        if(!cache_new(&c->c, s, E, b, policy, seed)) exit(FAIL);
+        lost_grow(&c->lost);
+    }
+
+    // an 'M' is a load and then a store, both before the next core's turn
+    for(size_t i=0; i<longest; i++) {
+        for(int k=0; k<ncores; k++) {
+            if(i >= core[k].n) continue;
+            a = &core[k].trace[i];
+            if(a->op != 'S') span_access(k, a->addr, a->size, false);
+            if(a->op != 'L') span_access(k, a->addr, a->size, true);
+        }
+    }
+
+    for(int k=0; k<ncores; k++) {
+        c = &core[k];
+        printf("core %d (%s): hits:%ld misses:%ld coherence-misses:%ld "
+               "true-sharing:%ld false-sharing:%ld evictions:%ld writebacks:%ld "
+               "upgrades:%ld invalidations-sent:%ld invalidations-received:%ld "
+               "requests:%ld\n",
+               k, c->path, (long)c->hit, (long)c->miss, (long)c->coher_miss,
+               (long)c->true_share, (long)c->false_share, (long)c->evict,
+               (long)c->writeback, (long)c->upgrade, (long)c->inval_sent,
+               (long)c->inval_recv, (long)c->requests);
+        cache_free(&c->c);
+        free(c->trace);
+        free(c->lost.key);
+        free(c->lost.mask);
+    }
+    if(net == NET_BUS)
+        printf("bus (%s): BusRd:%ld BusRdX:%ld BusUpgr:%ld writebacks:%ld snoops:%ld",
+               proto_name[protocol], (long)bus_rd, (long)bus_rdx, (long)bus_upgr,
+               (long)bus_wb, (long)snoops);
+    else
+        printf("directory (%s): requests:%ld forwards:%ld invalidations:%ld acks:%ld "
+               "replies:%ld puts:%ld messages:%ld",
+               proto_name[protocol], (long)msg_req, (long)msg_fwd, (long)msg_inv,
+               (long)msg_ack, (long)msg_reply, (long)msg_put,
+               (long)(msg_req + msg_fwd + msg_inv + msg_ack + msg_reply + msg_put));
+    printf(" cache-to-cache:%ld memory-reads:%ld memory-writes:%ld\n",
+           (long)c2c, (long)mem_read, (long)mem_write);
+}
@@ -0,0 +1,22 @@
+#ifndef COHER_H
+#define COHER_H
+
+#include "cache.h"
+
+#define COHER_MAX       (64)    // cores
+
+#define PROTO_MESI      (0)
+#define PROTO_MOESI     (1)
+
+#define NET_BUS         (0)     // snooping bus, every request is broadcast
+#define NET_DIR         (1)     // directory with exact sharer lists
+
+// adds a core running the trace at path.
+int     coher_add(const char* path);
+
+// runs the cores' traces interleaved one access at a time, each core
+// with a private cache of the -s, -E, -b geometry kept coherent with
+// protocol, and prints per-core and interconnect counts.
+void    coher_run(int protocol, int net, const policy_t* policy, uint32_t seed);
+
+#endif
@@ -0,0 +1,238 @@
+#include "hier.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#define SUCCESS     (0)
+#define FAIL        (1)
+#define SHL(X, Y)   ((X) << (Y))
+
+// multi-level hierarchy.
+//
+// an access walks down its path (L1I or L1D, then the shared levels),
+// paying each level's latency, until a level hits or memory is reached.
+// the block is then filled into every level above the hit except
+// exclusive ones. an eviction from an inclusive level back-invalidates
+// the block in all levels above it; an eviction from any level is moved
+// into the level below it when that level is exclusive (a victim fill),
+// and a hit in an exclusive level moves the block up out of it.
+
+typedef struct level_t {
+    char        name[16];
+    cache_t     c;
+    int         s, E, b;
+    const policy_t* repl;   // replacement policy, NULL for the default
+    int         latency;
+    int         policy;
+    int         depth;      // 0 for the top
+    char        kind;       // 'I' or 'D' for a split top, 0 if unified
+    stats_t     st;
+    int64_t     back_inval;
+    int64_t     victim_fill;
+} level_t;
+
+static level_t      level[HIER_MAX];
+static int          nlevels;
+static int          ndepth;
+
+static int          mem_latency_cycles;
+static int64_t      accesses;
+static int64_t      mem_accesses;
+static int64_t      cycles;
+
+static const char*  policy_name[] = { "non-inclusive", "inclusive", "exclusive" };
+
+int
+hier_add(const char* spec)
+{
+    level_t*    l;
+    char        name[16];
+    char        policy[8];
+    char        repl[16];
+    int         s, E, b, latency;
+    int         n;
+
+    if(nlevels == HIER_MAX) return FAIL;
+    policy[0] = 0;
+    repl[0] = 0;
+    n = sscanf(spec, "%15[^:]:%d:%d:%d:%d:%7[^:]:%15s",
+               name, &s, &E, &b, &latency, policy, repl);
+    if(n < 5 || s < 0 || s > 30 || E < 1 || b < 1 || s + b > 62 || latency < 0)
+        return FAIL;
+
+    l = &level[nlevels];
+    memset(l, 0, sizeof(level_t));
+    strcpy(l->name, name);
+    l->s = s;
+    l->E = E;
+    l->b = b;
+    l->latency = latency;
+    if(repl[0] && !(l->repl = policy_find(repl))) return FAIL;
+    if(!policy[0] || !strcmp(policy, "nine")) l->policy = POLICY_NINE;
+    else if(!strcmp(policy, "incl")) l->policy = POLICY_INCL;
+    else if(!strcmp(policy, "excl")) l->policy = POLICY_EXCL;
+    else return FAIL;
+
+    if(!strcasecmp(name, "L1I")) l->kind = 'I';
+    else if(!strcasecmp(name, "L1D")) l->kind = 'D';
+
+    // a split top is one level deep, whichever half comes first
+    if(l->kind && nlevels == 1 && level[0].kind && level[0].kind != l->kind)
+        l->depth = 0;
+    else if(l->kind && nlevels > 0)
+        return FAIL;
+    else
+        l->depth = ndepth;
+    if(l->depth == ndepth) ndepth++;
+    if(l->depth == 0 && l->policy == POLICY_EXCL) return FAIL;
+
+    nlevels++;
+    return SUCCESS;
+}
+
+static level_t*
+level_at(int depth, char kind)
+{
+    for(int i=0; i<nlevels; i++) {
+        if(level[i].depth == depth && (!level[i].kind || level[i].kind == kind))
+            return &level[i];
+    }
+    return NULL;
+}
+
+// drops every block of u that lies in the block at address of level l
+static void
+back_invalidate(level_t* l, level_t* u, uint64_t address)
+{
+    uint64_t    step;
+
+    if(u->c.b >= l->c.b) {
+        if(cache_invalidate(&u->c, address)) l->back_inval++;
+        return;
+    }
+    step = SHL((uint64_t)1, u->c.b);
+    for(uint64_t a=0; a<SHL((uint64_t)1, l->c.b); a+=step) {
+        if(cache_invalidate(&u->c, address + a)) l->back_inval++;
+    }
+}
+
+static void     level_fill(level_t* l, uint64_t address);
+
+static void
+evicted(level_t* l, uint64_t victim)
+{
+    level_t*    below;
+
+    if(l->policy == POLICY_INCL) {
+        for(int i=0; i<nlevels; i++) {
+            if(level[i].depth < l->depth) back_invalidate(l, &level[i], victim);
+        }
+    }
+    below = level_at(l->depth + 1, 0);
+    if(below && below->policy == POLICY_EXCL && cache_state(&below->c, victim) < 0) {
+        below->victim_fill++;
+        level_fill(below, victim);
+    }
+}
+
+static void
+level_fill(level_t* l, uint64_t address)
+{
+    uint64_t    victim;
+
+    if(cache_fill(&l->c, address, &victim, NULL)) {
+        l->st.evict++;
+        evicted(l, victim);
+    }
+}
+
+static void
+hier_access(char kind, uint64_t address)
+{
+    level_t*    path[HIER_MAX];
+    int         n;
+    int         hit;
+
+    n = 0;
+    for(int d=0; d<ndepth; d++) {
+        path[n] = level_at(d, kind);
+        if(path[n]) n++;
+    }
+
+    accesses++;
+    for(hit=0; hit<n; hit++) {
+        cycles += path[hit]->latency;
+        if(cache_lookup(&path[hit]->c, address)) {
+            path[hit]->st.hit++;
+            break;
+        }
+        path[hit]->st.miss++;
+    }
+    if(hit == n) {
+        mem_accesses++;
+        cycles += mem_latency_cycles;
+    }
+    else if(hit > 0 && path[hit]->policy == POLICY_EXCL) {
+        cache_invalidate(&path[hit]->c, address);
+    }
+
+    for(int i=hit-1; i>=0; i--) {
+        if(i > 0 && path[i]->policy == POLICY_EXCL) continue;
+        level_fill(path[i], address);
+    }
+}
+
+void
+hier_run(int mem_latency, const policy_t* policy, uint32_t seed)
+{
+    access_t*   batch;
+    level_t*    l;
+    bool        fetches;
+    int         n;
+
+    for(int i=0; i<nlevels; i++) {
+        l = &level[i];
+        if(!cache_new(&l->c, l->s, l->E, l->b, l->repl ? l->repl : policy, seed))
+            exit(FAIL);
+    }
+
+    mem_latency_cycles = mem_latency;
+    // without an L1I the trace is data only, as in the single cache mode
+    fetches = false;
+    for(int i=0; i<nlevels; i++) {
+        if(level[i].kind == 'I') fetches = true;
+    }
+    while((n = trace_read(&batch)) > 0) {
+        for(int i=0; i<n; i++) {
+            if(batch[i].op=='I') {
+                if(fetches) hier_access('I', batch[i].addr);
+                continue;
+            }
+            hier_access('D', batch[i].addr);
+            if(batch[i].op=='M') hier_access('D', batch[i].addr);
+        }
+    }
+
+    for(int i=0; i<nlevels; i++) {
+        l = &level[i];
+        printf("%s (%s, %s, %d sets x %d ways x %d bytes, %d cycles): "
+               "hits:%ld misses:%ld evictions:%ld",
+               l->name, policy_name[l->policy], l->c.policy->name, l->c.S, l->c.E,
+               SHL(1, l->c.b), l->latency, (long)l->st.hit,
+               (long)l->st.miss, (long)l->st.evict);
+        if(l->policy == POLICY_INCL)
+            printf(" back-invalidations:%ld", (long)l->back_inval);
+        if(l->policy == POLICY_EXCL)
+            printf(" victim-fills:%ld", (long)l->victim_fill);
+        printf("\n");
+        cache_free(&l->c);
+    }
+    printf("memory (%d cycles): accesses:%ld\n", mem_latency, (long)mem_accesses);
+    printf("AMAT: %.3f cycles over %ld accesses\n",
+           accesses ? (double)cycles / accesses : 0.0, (long)accesses);
+}
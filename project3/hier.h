@@ -0,0 +1,23 @@
+#ifndef HIER_H
+#define HIER_H
+
+#include "cache.h"
+
+#define HIER_MAX        (8)     // cache levels
+
+#define POLICY_NINE     (0)     // non-inclusive non-exclusive
+#define POLICY_INCL     (1)     // inclusive of the levels above
+#define POLICY_EXCL     (2)     // exclusive: holds only their victims
+
+// adds the level described by
+// "name:s:E:b:latency[:incl|excl|nine[:replacement policy]]".
+// levels go from the top down; a level named L1I or L1D takes only
+// instruction or data accesses and shares the top with the other one.
+int     hier_add(const char* spec);
+
+// runs the trace opened with trace_open through the hierarchy and
+// prints the per-level counts and the average memory access time.
+// levels without a policy of their own use policy, NULL for LRU.
+void    hier_run(int mem_latency, const policy_t* policy, uint32_t seed);
+
+#endif
@@ -0,0 +1,278 @@
+#include "opt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FAIL        (1)
+#define SAR(X, Y)   ((X) >> (Y))
+#define SHL(X, Y)   ((X) << (Y))
+
+#define NO_BLOCK    (UINT64_MAX)    // empty hash slot
+#define NEVER       (INT64_MAX)     // next use of a block not used again
+
+// optimal replacement.
+//
+// MIN evicts the line whose next use is the furthest away. the second
+// pass knows the next use of every access, so the policy below keeps the
+// ways of each set in a max-heap keyed by the next use of their line;
+// the victim is the root. a hit moves the line's next use later, so its
+// way only ever sifts up, and an access always fills its block even when
+// it is used later than every line of the set, like the other policies.
+
+typedef struct heap_meta_t {
+    int*        heap;       // S * W, ways of each set by next use
+    int*        pos;        // S * W, place of a way in its heap
+    int64_t*    next;       // S * W, next use of the line in a way
+    int*        n;          // S, ways in each heap
+} heap_meta_t;
+
+static cache_t*     target;
+static FILE*        blocks;         // block of each access
+static uint64_t     buf[OPT_CHUNK];
+static int          nbuf;
+static int64_t      count;
+static int64_t      now;            // next use of the access simulated
+
+static void
+heap_swap(heap_meta_t* m, size_t base, int i, int k)
+{
+    int     w = m->heap[base + i];
+
+    m->heap[base + i] = m->heap[base + k];
+    m->heap[base + k] = w;
+    m->pos[base + m->heap[base + i]] = i;
+    m->pos[base + m->heap[base + k]] = k;
+}
+
+static inline int64_t
+key(heap_meta_t* m, size_t base, int i)
+{
+    return m->next[base + m->heap[base + i]];
+}
+
+static void
+sift_up(heap_meta_t* m, size_t base, int i)
+{
+    while(i > 0 && key(m, base, (i - 1) / 2) < key(m, base, i)) {
+        heap_swap(m, base, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void
+sift_down(heap_meta_t* m, size_t base, int i, int n)
+{
+    int     k;
+
+    while((k = 2 * i + 1) < n) {
+        if(k + 1 < n && key(m, base, k + 1) > key(m, base, k)) k++;
+        if(key(m, base, k) <= key(m, base, i)) break;
+        heap_swap(m, base, i, k);
+        i = k;
+    }
+}
+
+static bool
+min_init(cache_t* c)
+{
+    heap_meta_t*    m;
+    size_t          ways = (size_t)c->S * c->W;
+
+    m = (heap_meta_t*)calloc(1, sizeof(heap_meta_t) + ways * 2 * sizeof(int)
+                                + ways * sizeof(int64_t) + c->S * sizeof(int));
+    if(!m) exit(FAIL);
+    m->next = (int64_t*)(m + 1);
+    m->heap = (int*)(m->next + ways);
+    m->pos = m->heap + ways;
+    m->n = m->pos + ways;
+    c->meta = m;
+    return true;
+}
+
+static void
+min_hit(cache_t* c, size_t index, int j)
+{
+    heap_meta_t*    m = (heap_meta_t*)c->meta;
+    size_t          base = index * c->W;
+
+    m->next[base + j] = now;
+    sift_up(m, base, m->pos[base + j]);
+}
+
+static void
+min_fill(cache_t* c, size_t index, int j)
+{
+    heap_meta_t*    m = (heap_meta_t*)c->meta;
+    size_t          base = index * c->W;
+    int             i = m->n[index]++;
+
+    m->heap[base + i] = j;
+    m->pos[base + j] = i;
+    m->next[base + j] = now;
+    sift_up(m, base, i);
+}
+
+static int
+min_victim(cache_t* c, size_t index)
+{
+    heap_meta_t*    m = (heap_meta_t*)c->meta;
+
+    return m->heap[index * c->W];
+}
+
+static void
+min_invalidate(cache_t* c, size_t index, int j)
+{
+    heap_meta_t*    m = (heap_meta_t*)c->meta;
+    size_t          base = index * c->W;
+    int             i = m->pos[base + j];
+    int             n = --m->n[index];
+    int             w;
+
+    if(i == n) return;
+    heap_swap(m, base, i, n);
+    w = m->heap[base + i];
+    sift_up(m, base, i);
+    sift_down(m, base, m->pos[base + w], n);
+}
+
+static const policy_t min_policy = {
+    "min", min_init, min_hit, min_fill, min_victim, min_invalidate, false
+};
+
+void
+opt_init(cache_t* c)
+{
+    target = c;
+    blocks = tmpfile();
+    if(!blocks) exit(FAIL);
+}
+
+void
+opt_record(uint64_t address)
+{
+    buf[nbuf++] = SAR(address, target->b);
+    count++;
+    if(nbuf < OPT_CHUNK) return;
+    if(fwrite(buf, sizeof(uint64_t), nbuf, blocks) != (size_t)nbuf) exit(FAIL);
+    nbuf = 0;
+}
+
+// the last use of each block seen so far, open addressing
+static uint64_t*    lkey;
+static int64_t*     lval;
+static size_t       lcap;
+static size_t       lused;
+
+static inline size_t
+lfind(uint64_t block)
+{
+    size_t  h = (size_t)((block * 0x9e3779b97f4a7c15ULL) >> 32) & (lcap - 1);
+
+    while(lkey[h] != NO_BLOCK && lkey[h] != block)
+        h = (h + 1) & (lcap - 1);
+    return h;
+}
+
+static void
+lgrow()
+{
+    uint64_t*   key = lkey;
+    int64_t*    val = lval;
+    size_t      cap = lcap;
+    size_t      h;
+
+    lcap = cap ? 2 * cap : 1024;
+    lkey = (uint64_t*)malloc(sizeof(uint64_t) * lcap);
+    lval = (int64_t*)malloc(sizeof(int64_t) * lcap);
+    if(!lkey || !lval) exit(FAIL);
+    memset(lkey, 0xff, sizeof(uint64_t) * lcap);
+    for(size_t i=0; i<cap; i++) {
+        if(key[i] == NO_BLOCK) continue;
+        h = lfind(key[i]);
+        lkey[h] = key[i];
+        lval[h] = val[i];
+    }
+    free(key);
+    free(val);
+}
+
+// writes the next use of every access to a new file, chunk by chunk
+// from the end of the sequence
+static FILE*
+next_uses()
+{
+    FILE*       uses = tmpfile();
+    int64_t*    next = (int64_t*)malloc(sizeof(int64_t) * OPT_CHUNK);
+    int64_t     lo, hi;
+    size_t      h;
+
+    if(!uses || !next) exit(FAIL);
+    lgrow();
+    for(hi=count; hi>0; hi=lo) {
+        lo = hi > OPT_CHUNK ? hi - OPT_CHUNK : 0;
+        if(fseeko(blocks, lo * sizeof(uint64_t), SEEK_SET)) exit(FAIL);
+        if(fread(buf, sizeof(uint64_t), hi - lo, blocks) != (size_t)(hi - lo)) exit(FAIL);
+        for(int64_t i=hi-1; i>=lo; i--) {
+            h = lfind(buf[i - lo]);
+            if(lkey[h] == buf[i - lo]) {
+                next[i - lo] = lval[h];
+                lval[h] = i;
+                continue;
+            }
+            next[i - lo] = NEVER;
+            if(2 * (lused + 1) > lcap) {
+                lgrow();
+                h = lfind(buf[i - lo]);
+            }
+            lkey[h] = buf[i - lo];
+            lval[h] = i;
+            lused++;
+        }
+        if(fseeko(uses, lo * sizeof(int64_t), SEEK_SET)) exit(FAIL);
+        if(fwrite(next, sizeof(int64_t), hi - lo, uses) != (size_t)(hi - lo)) exit(FAIL);
+    }
+    free(next);
+    free(lkey);
+    free(lval);
+    return uses;
+}
+
+void
+opt_run(stats_t* st)
+{
+    cache_t     opt;
+    FILE*       uses;
+    int64_t*    next = (int64_t*)malloc(sizeof(int64_t) * OPT_CHUNK);
+    size_t      n;
+    uint64_t    address;
+
+    if(!next) exit(FAIL);
+    if(nbuf && fwrite(buf, sizeof(uint64_t), nbuf, blocks) != (size_t)nbuf) exit(FAIL);
+    nbuf = 0;
+    uses = next_uses();
+    rewind(blocks);
+    rewind(uses);
+
+    if(!cache_new(&opt, target->s, target->E, target->b, &min_policy, 0)) exit(FAIL);
+    while((n = fread(buf, sizeof(uint64_t), OPT_CHUNK, blocks)) > 0) {
+        if(fread(next, sizeof(int64_t), n, uses) != n) exit(FAIL);
+        for(size_t i=0; i<n; i++) {
+            now = next[i];
+            address = SHL(buf[i], target->b);
+            if(cache_lookup(&opt, address)) {
+                st->hit++;
+                continue;
+            }
+            st->miss++;
+            if(cache_fill(&opt, address, NULL, NULL)) st->evict++;
+        }
+    }
+    cache_free(&opt);
+    free(next);
+    fclose(uses);
+    fclose(blocks);
+}
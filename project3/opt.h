@@ -0,0 +1,21 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "cache.h"
+
+#define OPT_CHUNK       (1 << 16)   // accesses per read or write of the spill files
+
+// records the block sequence of the accesses of c, to a temporary file
+// so that traces larger than memory can be replayed
+void    opt_init(cache_t* c);
+
+// one access, in trace order
+void    opt_record(uint64_t address);
+
+// simulates the recorded accesses on a cache of the geometry of c under
+// Belady's MIN policy and counts the optimal hits, misses and evictions
+// in st. a first pass from the end of the sequence writes the position
+// of the next use of every access to a second file.
+void    opt_run(stats_t* st);
+
+#endif
@@ -0,0 +1,382 @@
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FAIL        (1)
+
+#define RRPV_MAX    (3)         // 2-bit re-reference prediction values
+#define BRRIP_LONG  (32)        // BRRIP inserts 1 in 32 blocks at RRPV_MAX-1
+#define PSEL_MAX    (1023)      // 10-bit set dueling counter
+#define LEADERS     (32)        // leader sets of each kind for DRRIP
+
+// replacement policies.
+//
+// every policy keeps its per-set state in c->meta, set after set. the
+// random policies keep one xorshift state per set seeded from the set
+// index, so a set draws the same numbers whether the sets are simulated
+// on one thread or many.
+
+static void*
+meta_alloc(cache_t* c, size_t size)
+{
+    c->meta = calloc(1, size);
+    if(!c->meta) exit(FAIL);
+    return c->meta;
+}
+
+static inline uint32_t
+rng_seed(uint32_t seed, size_t index)
+{
+    uint32_t    x = seed * 0x9e3779b9u ^ (uint32_t)index * 0x85ebca6bu;
+
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    return x ? x : 1;
+}
+
+static inline uint32_t
+rng_next(uint32_t* x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// LRU and FIFO: a doubly linked list through the way indices of each set,
+// most recently filled (or used, for LRU) first.
+
+typedef struct list_t {
+    int     mru;
+    int     lru;
+} list_t;
+
+typedef struct list_meta_t {
+    int*    prev;       // S * W, way toward the head or -1
+    int*    next;       // S * W, way toward the tail or -1
+    list_t* head;       // S
+} list_meta_t;
+
+static bool
+list_init(cache_t* c)
+{
+    list_meta_t*    m;
+    size_t          ways = (size_t)c->S * c->W;
+
+    m = (list_meta_t*)meta_alloc(c, sizeof(list_meta_t)
+                                    + ways * 2 * sizeof(int) + c->S * sizeof(list_t));
+    m->prev = (int*)(m + 1);
+    m->next = m->prev + ways;
+    m->head = (list_t*)(m->next + ways);
+    memset(m->prev, 0xff, ways * 2 * sizeof(int));
+    memset(m->head, 0xff, c->S * sizeof(list_t));
+    return true;
+}
+
+static void
+list_unlink(cache_t* c, size_t index, int j)
+{
+    list_meta_t*    m = (list_meta_t*)c->meta;
+    int*            prev = m->prev + index * c->W;
+    int*            next = m->next + index * c->W;
+
+    if(prev[j] >= 0) next[prev[j]] = next[j];
+    else m->head[index].mru = next[j];
+    if(next[j] >= 0) prev[next[j]] = prev[j];
+    else m->head[index].lru = prev[j];
+}
+
+static void
+list_push(cache_t* c, size_t index, int j)
+{
+    list_meta_t*    m = (list_meta_t*)c->meta;
+    int*            prev = m->prev + index * c->W;
+    int*            next = m->next + index * c->W;
+
+    prev[j] = -1;
+    next[j] = m->head[index].mru;
+    if(next[j] >= 0) prev[next[j]] = j;
+    else m->head[index].lru = j;
+    m->head[index].mru = j;
+}
+
+static void
+lru_hit(cache_t* c, size_t index, int j)
+{
+    list_meta_t*    m = (list_meta_t*)c->meta;
+
+    if(m->head[index].mru == j) return;
+    list_unlink(c, index, j);
+    list_push(c, index, j);
+}
+
+static int
+list_victim(cache_t* c, size_t index)
+{
+    return ((list_meta_t*)c->meta)->head[index].lru;
+}
+
+static void
+none(cache_t* c, size_t index, int j)
+{
+    (void)c; (void)index; (void)j;
+}
+
+// random: one xorshift state per set
+
+static bool
+random_init(cache_t* c)
+{
+    uint32_t*   rng = (uint32_t*)meta_alloc(c, c->S * sizeof(uint32_t));
+
+    for(int i=0; i<c->S; i++) rng[i] = rng_seed(c->seed, i);
+    return true;
+}
+
+static int
+random_victim(cache_t* c, size_t index)
+{
+    return rng_next((uint32_t*)c->meta + index) % c->E;
+}
+
+// tree-PLRU: E-1 bits per set, a binary tree over the ways stored as a
+// heap from bit 1. a bit points to the half holding the next victim,
+// 0 for the lower half.
+
+static bool
+plru_init(cache_t* c)
+{
+    if(c->E & (c->E - 1)) return false;
+    meta_alloc(c, (size_t)c->S * ((c->E + 7) / 8));
+    return true;
+}
+
+static inline uint8_t*
+plru_bits(cache_t* c, size_t index)
+{
+    return (uint8_t*)c->meta + index * ((c->E + 7) / 8);
+}
+
+// points every node on the path to way j away from it, or toward it
+static void
+plru_point(cache_t* c, size_t index, int j, bool toward)
+{
+    uint8_t*    bits = plru_bits(c, index);
+    int         node = j + c->E;
+    int         up;
+
+    for(; node>1; node=up) {
+        up = node / 2;
+        if((node & 1) == toward) bits[up / 8] |= 1 << (up % 8);
+        else bits[up / 8] &= ~(1 << (up % 8));
+    }
+}
+
+static void
+plru_touch(cache_t* c, size_t index, int j)
+{
+    plru_point(c, index, j, false);
+}
+
+static int
+plru_victim(cache_t* c, size_t index)
+{
+    uint8_t*    bits = plru_bits(c, index);
+    int         node = 1;
+
+    while(node < c->E)
+        node = 2 * node + (bits[node / 8] >> (node % 8) & 1);
+    return node - c->E;
+}
+
+static void
+plru_invalidate(cache_t* c, size_t index, int j)
+{
+    plru_point(c, index, j, true);
+}
+
+// NRU: a referenced byte per way, cleared for the whole set when a
+// victim is needed and every way is referenced.
+
+static bool
+nru_init(cache_t* c)
+{
+    meta_alloc(c, (size_t)c->S * c->W);
+    return true;
+}
+
+static void
+nru_touch(cache_t* c, size_t index, int j)
+{
+    ((uint8_t*)c->meta)[index * c->W + j] = 1;
+}
+
+static int
+nru_victim(cache_t* c, size_t index)
+{
+    uint8_t*    ref = (uint8_t*)c->meta + index * c->W;
+
+    for(int j=0; j<c->E; j++) {
+        if(!ref[j]) return j;
+    }
+    memset(ref, 0, c->E);
+    return 0;
+}
+
+// LFU: an access count per way; the least counted way goes, the lowest
+// of equal ones first.
+
+static bool
+lfu_init(cache_t* c)
+{
+    meta_alloc(c, (size_t)c->S * c->W * sizeof(uint32_t));
+    return true;
+}
+
+static void
+lfu_hit(cache_t* c, size_t index, int j)
+{
+    uint32_t*   count = (uint32_t*)c->meta + index * c->W;
+
+    if(count[j] != UINT32_MAX) count[j]++;
+}
+
+static void
+lfu_fill(cache_t* c, size_t index, int j)
+{
+    ((uint32_t*)c->meta)[index * c->W + j] = 1;
+}
+
+static int
+lfu_victim(cache_t* c, size_t index)
+{
+    uint32_t*   count = (uint32_t*)c->meta + index * c->W;
+    int         min = 0;
+
+    for(int j=1; j<c->E; j++) {
+        if(count[j] < count[min]) min = j;
+    }
+    return min;
+}
+
+// RRIP: a 2-bit RRPV byte per way followed by one xorshift state per set.
+// SRRIP inserts at RRPV_MAX-1; BRRIP at RRPV_MAX, and 1 in BRRIP_LONG
+// blocks at RRPV_MAX-1. DRRIP dedicates LEADERS sets to each of them and
+// lets the others follow whichever leaders miss less: a miss in an SRRIP
+// leader counts psel up, one in a BRRIP leader counts it down.
+
+static bool
+rrip_init(cache_t* c)
+{
+    size_t      off = ((size_t)c->S * c->W + 3) / 4 * 4;
+    uint32_t*   rng;
+
+    meta_alloc(c, off + c->S * sizeof(uint32_t));
+    rng = (uint32_t*)((uint8_t*)c->meta + off);
+    for(int i=0; i<c->S; i++) rng[i] = rng_seed(c->seed, i);
+    c->psel = (PSEL_MAX + 1) / 2;
+    return true;
+}
+
+static inline uint8_t*
+rrip_rrpv(cache_t* c, size_t index)
+{
+    return (uint8_t*)c->meta + index * c->W;
+}
+
+static inline uint32_t*
+rrip_rng(cache_t* c, size_t index)
+{
+    size_t      off = ((size_t)c->S * c->W + 3) / 4 * 4;
+
+    return (uint32_t*)((uint8_t*)c->meta + off) + index;
+}
+
+static void
+rrip_hit(cache_t* c, size_t index, int j)
+{
+    rrip_rrpv(c, index)[j] = 0;
+}
+
+static int
+rrip_victim(cache_t* c, size_t index)
+{
+    uint8_t*    rrpv = rrip_rrpv(c, index);
+
+    while(1) {
+        for(int j=0; j<c->E; j++) {
+            if(rrpv[j] == RRPV_MAX) return j;
+        }
+        for(int j=0; j<c->E; j++) rrpv[j]++;
+    }
+}
+
+static void
+srrip_fill(cache_t* c, size_t index, int j)
+{
+    rrip_rrpv(c, index)[j] = RRPV_MAX - 1;
+}
+
+static void
+brrip_fill(cache_t* c, size_t index, int j)
+{
+    bool    near = rng_next(rrip_rng(c, index)) % BRRIP_LONG == 0;
+
+    rrip_rrpv(c, index)[j] = near ? RRPV_MAX - 1 : RRPV_MAX;
+}
+
+// 1 for an SRRIP leader, -1 for a BRRIP leader, 0 for a follower
+static inline int
+drrip_leader(cache_t* c, size_t index)
+{
+    size_t  stride = c->S / LEADERS > 2 ? c->S / LEADERS : 2;
+
+    if(index % stride == 0) return 1;
+    if(index % stride == stride / 2) return -1;
+    return 0;
+}
+
+// every fill is a miss of its set
+static void
+drrip_fill(cache_t* c, size_t index, int j)
+{
+    switch(drrip_leader(c, index)) {
+        case 1:
+            if(c->psel < PSEL_MAX) c->psel++;
+            srrip_fill(c, index, j);
+            break;
+        case -1:
+            if(c->psel > 0) c->psel--;
+            brrip_fill(c, index, j);
+            break;
+        default:
+            if(c->psel > PSEL_MAX / 2) brrip_fill(c, index, j);
+            else srrip_fill(c, index, j);
+    }
+}
+
+static const policy_t policies[] = {
+    { "lru",    list_init,      lru_hit,    list_push,  list_victim,    list_unlink,    false },
+    { "fifo",   list_init,      none,       list_push,  list_victim,    list_unlink,    false },
+    { "random", random_init,    none,       none,       random_victim,  none,           false },
+    { "plru",   plru_init,      plru_touch, plru_touch, plru_victim,    plru_invalidate, false },
+    { "nru",    nru_init,       nru_touch,  nru_touch,  nru_victim,     none,           false },
+    { "lfu",    lfu_init,       lfu_hit,    lfu_fill,   lfu_victim,     none,           false },
+    { "srrip",  rrip_init,      rrip_hit,   srrip_fill, rrip_victim,    none,           false },
+    { "brrip",  rrip_init,      rrip_hit,   brrip_fill, rrip_victim,    none,           false },
+    { "drrip",  rrip_init,      rrip_hit,   drrip_fill, rrip_victim,    none,           true },
+};
+
+const policy_t*
+policy_find(const char* name)
+{
+    for(size_t i=0; i<sizeof(policies)/sizeof(policies[0]); i++) {
+        if(!strcmp(policies[i].name, name)) return &policies[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,406 @@
+#include "prefetch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SUCCESS     (0)
+#define FAIL        (1)
+#define SAR(X, Y)   ((X) >> (Y))
+#define SHL(X, Y)   ((X) << (Y))
+
+#define NO_BLOCK    (UINT64_MAX)    // empty hash slot
+
+#define PF_TABLE    (256)       // stride table entries, direct mapped
+#define PF_CONF     (2)         // confidence needed to prefetch
+#define PF_REGION_B (12)        // log2 of the region size
+#define PF_FLIGHT   (1024)      // prefetches in flight
+#define PF_STREAMS  (16)        // most stream buffers
+#define PF_DEPTH    (4)         // blocks per stream buffer
+
+// prefetching.
+//
+// prefetched blocks are filled into the cache in state LINE_PREFETCHED,
+// which the first demand hit clears and counts as useful; one evicted
+// still in that state was useless. a block evicted by a prefetch fill is
+// remembered until it is demanded again, when the miss counts as
+// pollution; such evictions are kept out of the demand counts. with a delay, prefetches wait in flight, and a demand miss
+// to a block in flight is a late prefetch: it still misses and the
+// prefetch is dropped.
+//
+// stream buffers hold their blocks beside the cache instead. a demand
+// miss that finds its block in a buffer takes it into the cache as a
+// hit and tops the buffer up, dropping the blocks before it; a miss in
+// every buffer restarts the least recently used one after the block.
+
+typedef struct stride_t {
+    uint64_t    key;
+    uint64_t    last;
+    int64_t     stride;
+    int         conf;
+    bool        valid;
+} stride_t;
+
+typedef struct stream_t {
+    uint64_t    block[PF_DEPTH];
+    int64_t     ready[PF_DEPTH];
+    int         n;
+    uint64_t    next;           // next block to fetch
+    int64_t     used;
+} stream_t;
+
+static int          kinds;
+static int          degree_next = 1;
+static int          degree_stride = 1;
+static int          degree_region = 1;
+static int          nstreams = 4;
+
+static cache_t*     target;
+static int          delay;          // demand accesses a prefetch takes
+static int64_t      now;            // demand accesses so far
+static stats_t*     demand;
+
+static stride_t     by_pc[PF_TABLE];
+static stride_t     by_region[PF_TABLE];
+static stream_t     stream[PF_STREAMS];
+
+// prefetches in flight, in order of arrival
+static uint64_t     fl_block[PF_FLIGHT];
+static int64_t      fl_ready[PF_FLIGHT];
+static int          fl_head;
+static int          fl_n;
+
+// blocks evicted by prefetch fills
+static uint64_t*    pol_key;
+static size_t       pol_cap;
+static size_t       pol_used;
+
+static int64_t      issued;
+static int64_t      useful;
+static int64_t      late;
+static int64_t      useless;
+static int64_t      pollution;
+static int64_t      evictions;      // by prefetch fills, not in the demand counts
+
+int
+pf_parse(const char* spec)
+{
+    char        name[16];
+    int         n;
+    int         len;
+
+    while(*spec) {
+        n = 1;
+        len = 0;
+        if(sscanf(spec, "%15[a-z]%n", name, &len) != 1) return FAIL;
+        spec += len;
+        if(*spec == ':') {
+            n = (int)strtol(spec + 1, (char**)&spec, 10);
+            if(n < 1) return FAIL;
+        }
+        // a bare stream keeps the default number of buffers
+        else if(!strcmp(name, "stream")) n = nstreams;
+        if(!strcmp(name, "next")) {
+            kinds |= PF_NEXT;
+            degree_next = n;
+        }
+        else if(!strcmp(name, "stride")) {
+            kinds |= PF_STRIDE;
+            degree_stride = n;
+        }
+        else if(!strcmp(name, "region")) {
+            kinds |= PF_REGION;
+            degree_region = n;
+        }
+        else if(!strcmp(name, "stream")) {
+            if(n > PF_STREAMS) return FAIL;
+            kinds |= PF_STREAM;
+            nstreams = n;
+        }
+        else if(!strcmp(name, "adjacent")) kinds |= PF_ADJACENT;
+        else return FAIL;
+
+        if(*spec == ',') spec++;
+        else if(*spec) return FAIL;
+    }
+    return kinds ? SUCCESS : FAIL;
+}
+
+static inline size_t
+hash_block(uint64_t block, size_t cap)
+{
+    block *= 0x9e3779b97f4a7c15ULL;
+    return (size_t)(block >> 32) & (cap - 1);
+}
+
+static inline size_t
+pol_find(uint64_t block)
+{
+    size_t  h = hash_block(block, pol_cap);
+
+    while(pol_key[h] != NO_BLOCK && pol_key[h] != block)
+        h = (h + 1) & (pol_cap - 1);
+    return h;
+}
+
+static void
+pol_grow()
+{
+    uint64_t*   key = pol_key;
+    size_t      cap = pol_cap;
+
+    pol_cap = cap ? 2 * cap : 1024;
+    pol_key = (uint64_t*)malloc(sizeof(uint64_t) * pol_cap);
+    if(!pol_key) exit(FAIL);
+    memset(pol_key, 0xff, sizeof(uint64_t) * pol_cap);
+    for(size_t i=0; i<cap; i++) {
+        if(key[i] != NO_BLOCK) pol_key[pol_find(key[i])] = key[i];
+    }
+    free(key);
+}
+
+static void
+pol_add(uint64_t block)
+{
+    size_t      h;
+
+    if(2 * (pol_used + 1) > pol_cap) pol_grow();
+    h = pol_find(block);
+    if(pol_key[h] == block) return;
+    pol_key[h] = block;
+    pol_used++;
+}
+
+// removes block; false if it is absent
+static bool
+pol_take(uint64_t block)
+{
+    size_t  h;
+    size_t  i;
+    size_t  home;
+
+    if(!pol_used) return false;
+    h = pol_find(block);
+    if(pol_key[h] != block) return false;
+
+    // backward shift, as in a linear probing delete
+    for(i=(h+1)&(pol_cap-1); pol_key[i] != NO_BLOCK; i=(i+1)&(pol_cap-1)) {
+        home = hash_block(pol_key[i], pol_cap);
+        if(((i - home) & (pol_cap - 1)) >= ((i - h) & (pol_cap - 1))) {
+            pol_key[h] = pol_key[i];
+            h = i;
+        }
+    }
+    pol_key[h] = NO_BLOCK;
+    pol_used--;
+    return true;
+}
+
+// fills the block for a demand miss or an arrived prefetch
+static void
+fill(uint64_t block, bool prefetch)
+{
+    uint64_t    address = SHL(block, target->b);
+    uint64_t    victim;
+    uint8_t     st;
+
+    if(cache_fill(target, address, &victim, &st)) {
+        if(prefetch) evictions++;
+        else demand->evict++;
+        if(st == LINE_PREFETCHED) useless++;
+        if(prefetch) pol_add(SAR(victim, target->b));
+    }
+    if(prefetch) {
+        cache_set_state(target, address, LINE_PREFETCHED);
+        pol_take(block);
+    }
+}
+
+static bool
+flight_take(uint64_t block)
+{
+    for(int i=0; i<fl_n; i++) {
+        int     k = (fl_head + i) % PF_FLIGHT;
+
+        if(fl_block[k] != block) continue;
+        fl_block[k] = NO_BLOCK;
+        return true;
+    }
+    return false;
+}
+
+static void
+arrive()
+{
+    uint64_t    block;
+
+    while(fl_n && fl_ready[fl_head] <= now) {
+        block = fl_block[fl_head];
+        fl_head = (fl_head + 1) % PF_FLIGHT;
+        fl_n--;
+        if(block != NO_BLOCK && cache_state(target, SHL(block, target->b)) < 0)
+            fill(block, true);
+    }
+}
+
+static void
+issue(uint64_t block)
+{
+    if(cache_state(target, SHL(block, target->b)) >= 0) return;
+    if(!delay) {
+        issued++;
+        fill(block, true);
+        return;
+    }
+    if(fl_n == PF_FLIGHT) return;
+    for(int i=0; i<fl_n; i++) {
+        if(fl_block[(fl_head + i) % PF_FLIGHT] == block) return;
+    }
+    issued++;
+    fl_block[(fl_head + fl_n) % PF_FLIGHT] = block;
+    fl_ready[(fl_head + fl_n) % PF_FLIGHT] = now + delay;
+    fl_n++;
+}
+
+// trains the entry of key with address and prefetches along its stride
+static void
+stride_train(stride_t* table, uint64_t key, uint64_t address, int degree)
+{
+    stride_t*   e = &table[hash_block(key, PF_TABLE)];
+    int64_t     d;
+
+    if(!e->valid || e->key != key) {
+        e->valid = true;
+        e->key = key;
+        e->last = address;
+        e->stride = 0;
+        e->conf = 0;
+        return;
+    }
+    d = (int64_t)(address - e->last);
+    e->last = address;
+    if(d == e->stride) {
+        if(e->conf < 3) e->conf++;
+    }
+    else if(e->conf > 0) e->conf--;
+    else e->stride = d;
+
+    if(e->conf < PF_CONF || !e->stride) return;
+    for(int k=1; k<=degree; k++)
+        issue(SAR(address + (uint64_t)(k * e->stride), target->b));
+}
+
+// fetches the next blocks into stream buffer s up to its depth, passing
+// over the ones already cached
+static void
+stream_top_up(stream_t* s)
+{
+    for(int k=s->n; k<PF_DEPTH; k++, s->next++) {
+        if(cache_state(target, SHL(s->next, target->b)) >= 0) continue;
+        s->block[s->n] = s->next;
+        s->ready[s->n] = now + delay;
+        s->n++;
+        issued++;
+    }
+}
+
+// takes block out of the stream buffers: 1 if it was there, 2 if it
+// had not arrived yet, 0 if it was in none
+static int
+stream_take(uint64_t block)
+{
+    stream_t*   s;
+    stream_t*   lru;
+    int         ready;
+
+    lru = &stream[0];
+    for(int i=0; i<nstreams; i++) {
+        s = &stream[i];
+        if(s->used < lru->used) lru = s;
+        for(int j=0; j<s->n; j++) {
+            if(s->block[j] != block) continue;
+            ready = s->ready[j] <= now ? 1 : 2;
+            useless += j;
+            memmove(s->block, s->block + j + 1, sizeof(uint64_t) * (s->n - j - 1));
+            memmove(s->ready, s->ready + j + 1, sizeof(int64_t) * (s->n - j - 1));
+            s->n -= j + 1;
+            s->used = now;
+            stream_top_up(s);
+            return ready;
+        }
+    }
+
+    useless += lru->n;
+    lru->n = 0;
+    lru->next = block + 1;
+    lru->used = now;
+    stream_top_up(lru);
+    return 0;
+}
+
+void
+pf_init(cache_t* c, int d)
+{
+    target = c;
+    delay = d;
+    for(int i=0; i<PF_STREAMS; i++) stream[i].used = -1;
+    pol_grow();
+}
+
+void
+pf_access(stats_t* st, uint64_t pc, uint64_t address)
+{
+    uint64_t    block = SAR(address, target->b);
+    bool        trigger;
+    int         found;
+
+    demand = st;
+    now++;
+    arrive();
+
+    if(cache_lookup(target, address)) {
+        st->hit++;
+        // tagged next-line: the first use of a prefetched line triggers
+        trigger = cache_state(target, address) == LINE_PREFETCHED;
+        if(trigger) {
+            useful++;
+            cache_set_state(target, address, 0);
+        }
+    }
+    else {
+        trigger = true;
+        if(delay && flight_take(block)) late++;
+        if(pol_take(block)) pollution++;
+        found = kinds & PF_STREAM ? stream_take(block) : 0;
+        if(found == 1) {
+            st->hit++;
+            useful++;
+        }
+        else {
+            st->miss++;
+            if(found == 2) late++;
+        }
+        fill(block, false);
+        if(kinds & PF_ADJACENT) issue(block ^ 1);
+    }
+
+    if((kinds & PF_NEXT) && trigger) {
+        for(int k=1; k<=degree_next; k++) issue(block + k);
+    }
+    if(kinds & PF_STRIDE) stride_train(by_pc, pc, address, degree_stride);
+    if(kinds & PF_REGION)
+        stride_train(by_region, SAR(address, PF_REGION_B), address, degree_region);
+}
+
+void
+pf_report(const stats_t* st)
+{
+    printf("prefetches:%ld useful:%ld late:%ld useless:%ld pollution:%ld "
+           "prefetch-evictions:%ld accuracy:%.3f coverage:%.3f\n",
+           (long)issued, (long)useful, (long)late, (long)useless, (long)pollution,
+           (long)evictions,
+           issued ? (double)useful / issued : 0.0,
+           useful + st->miss ? (double)useful / (useful + st->miss) : 0.0);
+}
@@ -0,0 +1,28 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "cache.h"
+
+// prefetchers, any combination of them
+#define PF_NEXT         (1)     // next-line, tagged
+#define PF_STRIDE       (2)     // stride table indexed by PC
+#define PF_REGION       (4)     // stride table indexed by 4 KiB region
+#define PF_STREAM       (8)     // stream buffers beside the cache
+#define PF_ADJACENT     (16)    // the other block of an aligned pair
+
+// parses "name[:n],..." with names next, stride, region, stream and
+// adjacent. n is the degree of next, stride and region and the number
+// of stream buffers.
+int     pf_parse(const char* spec);
+
+// prefetched blocks arrive delay demand accesses after they are issued
+void    pf_init(cache_t* c, int delay);
+
+// one demand access of the instruction at pc, prefetching around it.
+// the demand hits, misses and evictions go to st.
+void    pf_access(stats_t* st, uint64_t pc, uint64_t address);
+
+// prints the prefetch counts
+void    pf_report(const stats_t* st);
+
+#endif
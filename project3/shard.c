@@ -0,0 +1,163 @@
+#include "shard.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#define FAIL        (1)
+#define SAR(X, Y)   ((X) >> (Y))
+
+#define QCHUNK      (1 << 13)   // addresses per chunk
+#define QCHUNKS     (8)         // chunks in flight per worker
+
+// set-sharded simulation.
+//
+// sets never interact, so the main thread splits the decoded accesses by
+// set into one queue per worker, keeping their order, and each worker
+// runs cache_simulate on its own range of sets with private counters.
+// ranges are contiguous so that workers do not share cache lines of the
+// tag arrays except at the borders. an 'M' is queued as two accesses.
+
+// single-producer single-consumer queue of address chunks
+typedef struct queue_t {
+    uint64_t*       chunk[QCHUNKS];
+    int             count[QCHUNKS];
+    int             head;
+    int             tail;
+    int             ready;
+    bool            done;
+    pthread_mutex_t lock;
+    pthread_cond_t  filled;
+    pthread_cond_t  drained;
+} queue_t;
+
+typedef struct worker_t {
+    pthread_t       thread;
+    queue_t         q;
+    uint64_t*       out;        // chunk being filled by the main thread
+    int             out_n;
+    stats_t         st;
+} worker_t;
+
+static worker_t*    worker;
+
+static void
+queue_publish(worker_t* w)
+{
+    queue_t*    q = &w->q;
+
+    pthread_mutex_lock(&q->lock);
+    q->count[q->tail] = w->out_n;
+    q->tail = (q->tail + 1) % QCHUNKS;
+    q->ready++;
+    pthread_cond_signal(&q->filled);
+    // slots still queued or being simulated count in ready
+    while(q->ready == QCHUNKS)
+        pthread_cond_wait(&q->drained, &q->lock);
+    w->out = q->chunk[q->tail];
+    w->out_n = 0;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void*
+worker_main(void* arg)
+{
+    worker_t*   w = (worker_t*)arg;
+    queue_t*    q = &w->q;
+    uint64_t*   chunk;
+    int         n;
+
+    while(1) {
+        pthread_mutex_lock(&q->lock);
+        while(!q->ready && !q->done)
+            pthread_cond_wait(&q->filled, &q->lock);
+        if(!q->ready) {
+            pthread_mutex_unlock(&q->lock);
+            break;
+        }
+        chunk = q->chunk[q->head];
+        n = q->count[q->head];
+        pthread_mutex_unlock(&q->lock);
+
+        for(int i=0; i<n; i++) cache_simulate(&w->st, chunk[i]);
+
+        pthread_mutex_lock(&q->lock);
+        q->head = (q->head + 1) % QCHUNKS;
+        q->ready--;
+        pthread_cond_signal(&q->drained);
+        pthread_mutex_unlock(&q->lock);
+    }
+    return NULL;
+}
+
+static inline void
+shard_push(worker_t* w, uint64_t address)
+{
+    w->out[w->out_n] = address;
+    if(++w->out_n == QCHUNK) queue_publish(w);
+}
+
+void
+shard_run(int threads, stats_t* total)
+{
+    access_t*   batch;
+    worker_t*   w;
+    uint64_t    s_mask;
+    int         shift;
+    int         n;
+
+    // worker k owns sets [k*S/threads, (k+1)*S/threads)
+    if(threads > S) threads = S;
+    s_mask = (uint64_t)S - 1;
+    worker = (worker_t*)calloc(threads, sizeof(worker_t));
+    if(!worker) exit(FAIL);
+    for(int k=0; k<threads; k++) {
+        w = &worker[k];
+        for(int i=0; i<QCHUNKS; i++) {
+            w->q.chunk[i] = (uint64_t*)malloc(sizeof(uint64_t) * QCHUNK);
+            if(!w->q.chunk[i]) exit(FAIL);
+        }
+        pthread_mutex_init(&w->q.lock, NULL);
+        pthread_cond_init(&w->q.filled, NULL);
+        pthread_cond_init(&w->q.drained, NULL);
+        w->out = w->q.chunk[0];
+        if(pthread_create(&w->thread, NULL, worker_main, w)) exit(FAIL);
+    }
+
+    shift = b;
+    while((n = trace_read(&batch)) > 0) {
+        for(int i=0; i<n; i++) {
+            uint64_t    index = SAR(batch[i].addr, shift) & s_mask;
+
+            if(batch[i].op=='I') continue;
+            w = &worker[index * threads / S];
+            shard_push(w, batch[i].addr);
+            if(batch[i].op=='M') shard_push(w, batch[i].addr);
+        }
+    }
+
+    for(int k=0; k<threads; k++) {
+        w = &worker[k];
+        if(w->out_n) queue_publish(w);
+        pthread_mutex_lock(&w->q.lock);
+        w->q.done = true;
+        pthread_cond_signal(&w->q.filled);
+        pthread_mutex_unlock(&w->q.lock);
+    }
+    for(int k=0; k<threads; k++) {
+        w = &worker[k];
+        pthread_join(w->thread, NULL);
+        total->hit += w->st.hit;
+        total->miss += w->st.miss;
+        total->evict += w->st.evict;
+        for(int i=0; i<QCHUNKS; i++) free(w->q.chunk[i]);
+        pthread_mutex_destroy(&w->q.lock);
+        pthread_cond_destroy(&w->q.filled);
+        pthread_cond_destroy(&w->q.drained);
+    }
+    free(worker);
+}
@@ -0,0 +1,12 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "cache.h"
+
+#define SHARD_MAX   (64)    // worker threads
+
+// simulates the trace opened with trace_open on `threads` workers, each
+// owning a contiguous range of sets, and adds their counters to total.
+void    shard_run(int threads, stats_t* total);
+
+#endif
@@ -0,0 +1,323 @@
+#include "sweep.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FAIL        (1)
+#define SAR(X, Y)   ((X) >> (Y))
+#define SHL(X, Y)   ((X) << (Y))
+
+#define NO_BLOCK    (UINT64_MAX)    // empty hash slot or freed time slot
+
+// single-pass LRU sweep by stack distance.
+//
+// an access hits in an LRU set of E ways exactly when fewer than E other
+// blocks of its set were touched since its previous access (its stack
+// distance is < E), so one histogram of distances per (s, b) pair gives
+// the hits for every E. distances are counted with a Fenwick tree per
+// set over that set's access times, in which only the latest access of
+// each block is marked; the distance of an access is the number of marks
+// after the previous access of the block. when a set runs out of time
+// slots, its marks are renumbered 0..live-1 and the tree is rebuilt, so
+// its size stays proportional to the number of distinct blocks.
+//
+// LRU sets never invalidate lines, so a set of E ways evicts on every
+// miss after its first min(E, distinct blocks) fills.
+
+// per-set distance tree
+typedef struct sd_set_t {
+    int*        bit;        // Fenwick tree over time slots
+    uint64_t*   slot;       // block marked at each time slot
+    int         cap;
+    int         clock;      // next time slot
+    int         live;       // distinct blocks seen in the set
+} sd_set_t;
+
+// one (s, b) pair
+struct sd_conf_t {
+    int         s;
+    int         b;
+    sd_set_t*   sets;
+    uint64_t*   key;        // block -> time slot, open addressing
+    int*        val;
+    size_t      hcap;
+    size_t      hused;
+    uint64_t*   hist;       // hist[d] accesses at distance d, [emax] for
+                            // larger distances and first accesses
+};
+
+static int          emax;
+
+int
+sweep_parse(const char* arg, int* vals)
+{
+    char*   end;
+    long    lo;
+    long    hi;
+    int     n;
+
+    n = 0;
+    while(*arg) {
+        lo = strtol(arg, &end, 10);
+        if(end == arg) return -1;
+        hi = lo;
+        if(*end == '-') {
+            arg = end + 1;
+            hi = strtol(arg, &end, 10);
+            if(end == arg) return -1;
+        }
+        for(long v=lo; v<=hi; v++) {
+            if(n == SWEEP_MAX) return -1;
+            vals[n++] = (int)v;
+        }
+        if(*end == ',') end++;
+        else if(*end) return -1;
+        arg = end;
+    }
+    return n;
+}
+
+static inline size_t
+hash_block(uint64_t block, size_t cap)
+{
+    block *= 0x9e3779b97f4a7c15ULL;
+    return (size_t)(block >> 32) & (cap - 1);
+}
+
+// returns the hash slot of block, or the empty slot where it belongs
+static inline size_t
+hash_find(sd_conf_t* c, uint64_t block)
+{
+    size_t  h = hash_block(block, c->hcap);
+
+    while(c->key[h] != NO_BLOCK && c->key[h] != block)
+        h = (h + 1) & (c->hcap - 1);
+    return h;
+}
+
+static void
+hash_grow(sd_conf_t* c)
+{
+    uint64_t*   key = c->key;
+    int*        val = c->val;
+    size_t      cap = c->hcap;
+    size_t      h;
+
+    c->hcap = cap ? 2 * cap : 1024;
+    c->key = (uint64_t*)malloc(sizeof(uint64_t) * c->hcap);
+    c->val = (int*)malloc(sizeof(int) * c->hcap);
+    if(!c->key || !c->val) exit(FAIL);
+    memset(c->key, 0xff, sizeof(uint64_t) * c->hcap);
+    for(size_t i=0; i<cap; i++) {
+        if(key[i] == NO_BLOCK) continue;
+        h = hash_find(c, key[i]);
+        c->key[h] = key[i];
+        c->val[h] = val[i];
+    }
+    free(key);
+    free(val);
+}
+
+static inline void
+bit_add(int* bit, int cap, int i, int d)
+{
+    for(i++; i<=cap; i+=i&-i) bit[i] += d;
+}
+
+// number of marks in slots 0..i
+static inline int
+bit_sum(const int* bit, int i)
+{
+    int     sum = 0;
+
+    for(i++; i>0; i-=i&-i) sum += bit[i];
+    return sum;
+}
+
+// renumbers the marked slots of set st 0..live-1, growing the tree when
+// more than half of it is live.
+static void
+set_compact(sd_conf_t* c, sd_set_t* st)
+{
+    uint64_t*   slot;
+    int         cap;
+    int         n;
+
+    cap = st->cap ? st->cap : 8;
+    while(cap < 2 * st->live) cap *= 2;
+    slot = (uint64_t*)malloc(sizeof(uint64_t) * cap);
+    if(!slot) exit(FAIL);
+
+    n = 0;
+    for(int t=0; t<st->clock; t++) {
+        if(st->slot[t] == NO_BLOCK) continue;
+        c->val[hash_find(c, st->slot[t])] = n;
+        slot[n++] = st->slot[t];
+    }
+    free(st->slot);
+    free(st->bit);
+    st->slot = slot;
+    st->cap = cap;
+    st->clock = n;
+    st->bit = (int*)calloc(cap + 1, sizeof(int));
+    if(!st->bit) exit(FAIL);
+    // linear-time build: every node passes its count to its parent
+    for(int i=1; i<=n; i++) st->bit[i]++;
+    for(int i=1; i<=cap; i++) {
+        if(i + (i&-i) <= cap) st->bit[i + (i&-i)] += st->bit[i];
+    }
+}
+
+int
+sd_access(sd_conf_t* c, uint64_t address)
+{
+    uint64_t    block;
+    sd_set_t*   st;
+    size_t      h;
+    int         dist;
+    int         t;
+
+    block = SAR(address, c->b);
+    st = &c->sets[block & (SHL((uint64_t)1, c->s) - 1)];
+
+    h = hash_find(c, block);
+    if(c->key[h] == block) {
+        t = c->val[h];
+        dist = st->live - bit_sum(st->bit, t);
+        bit_add(st->bit, st->cap, t, -1);
+        st->slot[t] = NO_BLOCK;
+    }
+    else {
+        dist = -1;
+        st->live++;
+        if(2 * (c->hused + 1) > c->hcap) {
+            hash_grow(c);
+            h = hash_find(c, block);
+        }
+        c->key[h] = block;
+        c->hused++;
+    }
+
+    if(st->clock == st->cap) {
+        set_compact(c, st);
+        h = hash_find(c, block);
+    }
+    t = st->clock++;
+    st->slot[t] = block;
+    bit_add(st->bit, st->cap, t, 1);
+    c->val[h] = t;
+    return dist;
+}
+
+static void
+sd_init(sd_conf_t* c, int s, int b)
+{
+    c->s = s;
+    c->b = b;
+    c->sets = (sd_set_t*)calloc(SHL((size_t)1, c->s), sizeof(sd_set_t));
+    if(!c->sets) exit(FAIL);
+    hash_grow(c);
+}
+
+static void
+sd_release(sd_conf_t* c)
+{
+    for(size_t i=0; i<SHL((size_t)1, c->s); i++) {
+        free(c->sets[i].bit);
+        free(c->sets[i].slot);
+    }
+    free(c->sets);
+    free(c->key);
+    free(c->val);
+    free(c->hist);
+}
+
+sd_conf_t*
+sd_new(int s, int b)
+{
+    sd_conf_t*  c = (sd_conf_t*)calloc(1, sizeof(sd_conf_t));
+
+    if(!c) exit(FAIL);
+    sd_init(c, s, b);
+    return c;
+}
+
+void
+sd_free(sd_conf_t* c)
+{
+    sd_release(c);
+    free(c);
+}
+
+static void
+sweep_access(sd_conf_t* c, uint64_t address)
+{
+    int     dist = sd_access(c, address);
+
+    c->hist[dist >= 0 && dist < emax ? dist : emax]++;
+}
+
+void
+sweep_run(const int* sv, int ns, const int* ev, int ne, const int* bv, int nb)
+{
+    sd_conf_t*  conf;
+    access_t*   batch;
+    uint64_t    total;
+    uint64_t    hits;
+    uint64_t    fills;
+    int         nconf;
+    int         n;
+
+    emax = 0;
+    for(int k=0; k<ne; k++) {
+        if(ev[k] > emax) emax = ev[k];
+    }
+
+    nconf = ns * nb;
+    conf = (sd_conf_t*)calloc(nconf, sizeof(sd_conf_t));
+    if(!conf) exit(FAIL);
+    for(int i=0; i<nb; i++) {
+        for(int j=0; j<ns; j++) {
+            sd_conf_t*  c = &conf[i * ns + j];
+
+            sd_init(c, sv[j], bv[i]);
+            c->hist = (uint64_t*)calloc(emax + 1, sizeof(uint64_t));
+            if(!c->hist) exit(FAIL);
+        }
+    }
+
+    while((n = trace_read(&batch)) > 0) {
+        for(int k=0; k<nconf; k++) {
+            for(int i=0; i<n; i++) {
+                if(batch[i].op=='I') continue;
+                sweep_access(&conf[k], batch[i].addr);
+                if(batch[i].op=='M') sweep_access(&conf[k], batch[i].addr);
+            }
+        }
+    }
+
+    for(int k=0; k<nconf; k++) {
+        sd_conf_t*  c = &conf[k];
+        size_t      S = SHL((size_t)1, c->s);
+
+        total = 0;
+        for(int d=0; d<=emax; d++) total += c->hist[d];
+        for(int e=0; e<ne; e++) {
+            hits = 0;
+            for(int d=0; d<ev[e]; d++) hits += c->hist[d];
+            fills = 0;
+            for(size_t i=0; i<S; i++)
+                fills += c->sets[i].live < ev[e] ? c->sets[i].live : ev[e];
+            printf("s:%d E:%d b:%d hits:%lu misses:%lu evictions:%lu\n",
+                   c->s, ev[e], c->b, (unsigned long)hits,
+                   (unsigned long)(total - hits),
+                   (unsigned long)(total - hits - fills));
+        }
+        sd_release(c);
+    }
+    free(conf);
+}
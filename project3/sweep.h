@@ -0,0 +1,29 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+
+#define SWEEP_MAX   (64)    // values per swept parameter
+
+// LRU stack distances of one (s, b) pair
+typedef struct sd_conf_t    sd_conf_t;
+
+sd_conf_t*  sd_new(int s, int b);
+void        sd_free(sd_conf_t* c);
+
+// records an access and returns its stack distance within its set: the
+// number of other blocks of the set touched since the block's previous
+// access, or -1 for the first access to the block.
+int         sd_access(sd_conf_t* c, uint64_t address);
+
+// parses a list such as "1,2,4-8" into vals; returns the number of
+// values, or -1 if the list is malformed or too long.
+int     sweep_parse(const char* arg, int* vals);
+
+// simulates every combination of the given set bits, associativities
+// and block bits in one pass over the trace opened with trace_open, and
+// prints the hit/miss/eviction counts of each.
+void    sweep_run(const int* sv, int ns, const int* ev, int ne,
+                  const int* bv, int nb);
+
+#endif
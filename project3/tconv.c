@@ -0,0 +1,122 @@
+#include "trace.h"
+#include "tracefmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#define SUCCESS     (0)
+#define FAIL        (1)
+
+// converts a trace to the binary format of tracefmt.h:
+// tconv [-t trace] -o out. the input may be text or binary, so that a
+// binary trace can be checked by converting it again.
+
+char*       trace_loc;
+char*       out_loc;
+
+uint8_t*    buf;            // the block being encoded
+uint8_t*    index_buf;
+int64_t     nblocks;
+int64_t     index_cap;
+
+static void
+index_add(uint64_t off, uint32_t len, uint32_t n)
+{
+    if(nblocks == index_cap) {
+        index_cap = index_cap ? 2 * index_cap : 256;
+        index_buf = (uint8_t*)realloc(index_buf, index_cap * TRACEFMT_ENTRY);
+        if(!index_buf) exit(FAIL);
+    }
+    tracefmt_put(index_buf + nblocks * TRACEFMT_ENTRY, off, 8);
+    tracefmt_put(index_buf + nblocks * TRACEFMT_ENTRY + 8, len, 4);
+    tracefmt_put(index_buf + nblocks * TRACEFMT_ENTRY + 12, n, 4);
+    nblocks++;
+}
+
+// encodes n accesses as one block
+static size_t
+block_encode(const access_t* a, int n)
+{
+    uint64_t    prev[4] = { 0, 0, 0, 0 };
+    uint8_t*    p = buf;
+    int         op;
+
+    for(int i=0; i<n; i++) {
+        op = tracefmt_opcode(a[i].op);
+        if(a[i].size < TRACEFMT_BIGSIZE) *p++ = (uint8_t)(op | a[i].size << 2);
+        else {
+            *p++ = (uint8_t)(op | TRACEFMT_BIGSIZE << 2);
+            p = varint_put(p, a[i].size);
+        }
+        p = varint_put(p, zigzag((int64_t)(a[i].addr - prev[op])));
+        prev[op] = a[i].addr;
+    }
+    return p - buf;
+}
+
+int main(int argc, char *argv[])
+{
+    char        op;
+    FILE*       out;
+    access_t*   batch;
+    uint8_t     header[TRACEFMT_HEADER];
+    uint64_t    off;
+    size_t      len;
+    int         threads = 1;
+    int         n;
+
+    while((op = getopt(argc, argv, "t:o:p:")) != -1) {
+        switch(op) {
+            case 't':
+                trace_loc = optarg;
+                break;
+            case 'o':
+                out_loc = optarg;
+                break;
+            case 'p':
+                threads = atoi(optarg);
+                if(threads < 1) return FAIL;
+                break;
+            default:
+                return FAIL;
+        }
+    }
+    // the header is rewritten at the end, so out must be seekable
+    if(!out_loc) return FAIL;
+
+    buf = (uint8_t*)malloc((size_t)TRACEFMT_BLOCK * TRACEFMT_MAXACCESS);
+    out = fopen(out_loc, "wb");
+    if(!buf || !out) return FAIL;
+    if(trace_open(trace_loc, threads) != SUCCESS) return FAIL;
+
+    memset(header, 0, sizeof(header));
+    if(fwrite(header, 1, sizeof(header), out) != sizeof(header)) return FAIL;
+    off = TRACEFMT_HEADER;
+    // batches hold at most TRACEFMT_BLOCK accesses
+    while((n = trace_read(&batch)) > 0) {
+        len = block_encode(batch, n);
+        if(fwrite(buf, 1, len, out) != len) return FAIL;
+        index_add(off, (uint32_t)len, (uint32_t)n);
+        off += len;
+    }
+    trace_close();
+
+    tracefmt_put(header, nblocks, 8);
+    if(fwrite(header, 1, 8, out) != 8) return FAIL;
+    if(nblocks && fwrite(index_buf, TRACEFMT_ENTRY, nblocks, out) != (size_t)nblocks)
+        return FAIL;
+
+    memcpy(header, TRACEFMT_MAGIC, 4);
+    tracefmt_put(header + 4, TRACEFMT_VERSION, 4);
+    tracefmt_put(header + 8, off, 8);
+    if(fseek(out, 0, SEEK_SET) || fwrite(header, 1, sizeof(header), out) != sizeof(header))
+        return FAIL;
+    if(fclose(out)) return FAIL;
+
+    free(buf);
+    free(index_buf);
+    return SUCCESS;
+}
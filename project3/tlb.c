@@ -0,0 +1,152 @@
+#include "tlb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SUCCESS     (0)
+#define FAIL        (1)
+#define SAR(X, Y)   ((X) >> (Y))
+#define SHL(X, Y)   ((X) << (Y))
+
+#define VA_BITS     (48)            // canonical virtual addresses
+#define PT_BASE     (SHL(1ULL, 60)) // page tables, far from any trace data
+#define PT_SPAN     (SHL(1ULL, 40)) // room for each level's entries
+
+// address translation.
+//
+// trace addresses are virtual and mapped to themselves, so the data
+// cache sees them unchanged. each TLB level is a cache whose blocks are
+// pages: an access looks its page up from the top down, and the page is
+// filled into every level above the one that held it. a miss in every
+// level walks a four level radix table, or three for 2 MB pages whose
+// walk stops at the directory. the entries of each table level lie in
+// one linear array indexed by the page number at that level, so the
+// entries of neighbouring pages share cache blocks as in a real table.
+
+typedef struct tlb_level_t {
+    char        name[16];
+    int         entries;
+    int         ways;
+    cache_t     c;
+    stats_t     st;
+} tlb_level_t;
+
+static tlb_level_t  level[TLB_MAX];
+static int          nlevels;
+static int          page_bits = PAGE_4K;
+
+static cache_t*     target;
+static bool         inject;
+static int64_t      walks;
+static int64_t      walk_refs;
+static stats_t      walk;           // of the injected references
+
+int
+tlb_add(const char* spec)
+{
+    tlb_level_t*    l;
+    int             entries, ways;
+
+    if(nlevels == TLB_MAX) return FAIL;
+    l = &level[nlevels];
+    memset(l, 0, sizeof(tlb_level_t));
+    if(sscanf(spec, "%15[^:]:%d:%d", l->name, &entries, &ways) != 3) return FAIL;
+    if(ways < 1 || entries < ways || entries % ways) return FAIL;
+    if((entries / ways) & (entries / ways - 1)) return FAIL;
+    l->entries = entries;
+    l->ways = ways;
+    nlevels++;
+    return SUCCESS;
+}
+
+int
+tlb_page(const char* size)
+{
+    if(!strcmp(size, "4k")) page_bits = PAGE_4K;
+    else if(!strcmp(size, "2m")) page_bits = PAGE_2M;
+    else return FAIL;
+    return SUCCESS;
+}
+
+void
+tlb_init(cache_t* c, bool inj)
+{
+    tlb_level_t*    l;
+
+    target = c;
+    inject = inj;
+    for(int i=0; i<nlevels; i++) {
+        l = &level[i];
+        if(!cache_new(&l->c, __builtin_ctz(l->entries / l->ways), l->ways, page_bits,
+                      NULL, 0))
+            exit(FAIL);
+    }
+}
+
+// one reference of a walk, reading the entry of the table at depth
+// level (0 for the root) that maps address
+static void
+walk_ref(int depth, uint64_t address)
+{
+    int         shift = PAGE_4K + 9 * (3 - depth);
+    uint64_t    entry;
+
+    walk_refs++;
+    if(!inject) return;
+    entry = PT_BASE + depth * PT_SPAN + SAR(address & (SHL(1ULL, VA_BITS) - 1), shift) * 8;
+    if(cache_lookup(target, entry)) {
+        walk.hit++;
+        return;
+    }
+    walk.miss++;
+    if(cache_fill(target, entry, NULL, NULL)) walk.evict++;
+}
+
+void
+tlb_access(uint64_t address)
+{
+    int     i;
+
+    for(i=0; i<nlevels; i++) {
+        if(cache_lookup(&level[i].c, address)) {
+            level[i].st.hit++;
+            break;
+        }
+        level[i].st.miss++;
+    }
+    if(i == nlevels) {
+        walks++;
+        for(int depth=0; depth<(page_bits == PAGE_2M ? 3 : 4); depth++)
+            walk_ref(depth, address);
+    }
+    while(--i >= 0) {
+        if(cache_fill(&level[i].c, address, NULL, NULL)) level[i].st.evict++;
+    }
+}
+
+void
+tlb_report()
+{
+    tlb_level_t*    l;
+    int64_t         n;
+
+    for(int i=0; i<nlevels; i++) {
+        l = &level[i];
+        n = l->st.hit + l->st.miss;
+        printf("%s TLB (%d entries, %d ways, %s pages): hits:%ld misses:%ld "
+               "evictions:%ld miss-rate:%.6f\n",
+               l->name, l->entries, l->ways, page_bits == PAGE_2M ? "2 MB" : "4 KB",
+               (long)l->st.hit, (long)l->st.miss, (long)l->st.evict,
+               n ? (double)l->st.miss / n : 0.0);
+        cache_free(&l->c);
+    }
+    printf("page walks:%ld references:%ld", (long)walks, (long)walk_refs);
+    if(inject) {
+        printf(" cache-hits:%ld cache-misses:%ld cache-evictions:%ld",
+               (long)walk.hit, (long)walk.miss, (long)walk.evict);
+    }
+    printf("\n");
+}
@@ -0,0 +1,28 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include "cache.h"
+
+#define TLB_MAX         (4)     // TLB levels
+
+#define PAGE_4K         (12)    // page bits
+#define PAGE_2M         (21)
+
+// adds the TLB level described by "name:entries:ways", from the top
+// down. entries must be ways times a power of two.
+int     tlb_add(const char* spec);
+
+// "4k" or "2m", the size of every page
+int     tlb_page(const char* size);
+
+// translates the data accesses of c. with inject, the page-walk
+// references of every TLB miss are sent through c as well.
+void    tlb_init(cache_t* c, bool inject);
+
+// translates the page of one data access
+void    tlb_access(uint64_t address);
+
+// prints the per-level TLB counts and the page walks
+void    tlb_report();
+
+#endif
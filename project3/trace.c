@@ -0,0 +1,372 @@
+#include "trace.h"
+#include "tracefmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SUCCESS         (0)
+#define FAIL            (1)
+
+#define TRACE_BATCH     TRACEFMT_BLOCK  // accesses per batch
+#define TRACE_DECODERS  (16)        // threads decoding a binary trace
+#define TRACE_BLOCK     (1 << 20)   // bytes per read() from a pipe
+
+#define TRACE_BATCHES   (4)         // batches in flight per reader thread
+
+// a ring of batches numbered in trace order. batch k goes to slot
+// k % slots once batch k - slots has been consumed; the simulator
+// consumes batch `head`. a text trace is parsed by one reader thread,
+// batch after batch; the blocks of a binary trace are decoded by several
+// threads, each claiming the next block.
+typedef struct ring_t {
+    access_t*       batch[TRACE_BATCHES * TRACE_DECODERS];
+    int             count[TRACE_BATCHES * TRACE_DECODERS];
+    bool            full[TRACE_BATCHES * TRACE_DECODERS];
+    int             slots;
+    int64_t         head;
+    int64_t         tail;       // next batch to produce
+    int64_t         last;       // number of batches once known
+    bool            held;       // the simulator still owns batch head
+    pthread_mutex_t lock;
+    pthread_cond_t  filled;
+    pthread_cond_t  drained;
+} ring_t;
+
+static ring_t       ring;
+static pthread_t    reader[TRACE_DECODERS];
+static int          nreaders;
+static int          trace_fd;
+static char*        map;
+static size_t       map_len;
+static bool         map_read;       // map was read from a pipe, not mapped
+static char         peek[4];        // first bytes of a pipe, not yet parsed
+static size_t       peek_len;
+
+// the index of a binary trace
+static const uint8_t*   blocks;
+static int64_t          nblocks;
+
+// the batch being filled by the text reader
+static access_t*    out;
+static int          out_n;
+
+// hands batch k with n accesses to the simulator. call with the lock.
+static void
+ring_put(int64_t k, int n)
+{
+    ring.count[k % ring.slots] = n;
+    ring.full[k % ring.slots] = true;
+    pthread_cond_signal(&ring.filled);
+}
+
+// waits until the slot of batch k is free. call with the lock.
+static void
+ring_wait(int64_t k)
+{
+    while(k >= ring.head + ring.slots)
+        pthread_cond_wait(&ring.drained, &ring.lock);
+}
+
+static void
+batch_publish()
+{
+    pthread_mutex_lock(&ring.lock);
+    ring_put(ring.tail++, out_n);
+    ring_wait(ring.tail);
+    out = ring.batch[ring.tail % ring.slots];
+    out_n = 0;
+    pthread_mutex_unlock(&ring.lock);
+}
+
+// decodes one line [p, end); anything that is not an access is skipped.
+static inline void
+parse_line(const char* p, const char* end)
+{
+    uint64_t    addr;
+    uint32_t    size;
+    char        op;
+    int         d;
+
+    while(p < end && *p == ' ') p++;
+    if(p == end) return;
+    op = *p++;
+    if(op != 'I' && op != 'L' && op != 'S' && op != 'M') return;
+    while(p < end && *p == ' ') p++;
+
+    addr = 0;
+    for(d = 0; p < end; p++, d++) {
+        if(*p >= '0' && *p <= '9') addr = addr << 4 | (*p - '0');
+        else if(*p >= 'a' && *p <= 'f') addr = addr << 4 | (*p - 'a' + 10);
+        else if(*p >= 'A' && *p <= 'F') addr = addr << 4 | (*p - 'A' + 10);
+        else break;
+    }
+    if(!d || p == end || *p++ != ',') return;
+    for(size = 0; p < end && *p >= '0' && *p <= '9'; p++)
+        size = size * 10 + (*p - '0');
+
+    out[out_n].addr = addr;
+    out[out_n].size = size;
+    out[out_n].op = op;
+    if(++out_n == TRACE_BATCH) batch_publish();
+}
+
+// parses the complete lines of [p, end), and the unterminated last line
+// too when final is set. returns where the unparsed rest begins.
+static const char*
+parse_block(const char* p, const char* end, bool final)
+{
+    const char* nl;
+
+    while(p < end) {
+        nl = memchr(p, '\n', end - p);
+        if(!nl) {
+            if(!final) break;
+            nl = end;
+        }
+        parse_line(p, nl);
+        p = nl + 1;
+    }
+    return p < end ? p : end;
+}
+
+static void*
+reader_main(void* arg)
+{
+    char*       buf;
+    const char* rest;
+    size_t      len;
+    ssize_t     n;
+
+    (void)arg;
+    if(map) {
+        parse_block(map, map + map_len, true);
+    }
+    else {
+        buf = (char*)malloc(2 * TRACE_BLOCK);
+        if(!buf) exit(FAIL);
+        memcpy(buf, peek, peek_len);
+        len = peek_len;
+        while((n = read(trace_fd, buf + len, TRACE_BLOCK)) > 0) {
+            len += n;
+            rest = parse_block(buf, buf + len, false);
+            len = buf + len - rest;
+            if(len >= TRACE_BLOCK) exit(FAIL);     // absurdly long line
+            memmove(buf, rest, len);
+        }
+        if(n < 0) exit(FAIL);
+        parse_block(buf, buf + len, true);
+        free(buf);
+    }
+
+    if(out_n) batch_publish();
+    pthread_mutex_lock(&ring.lock);
+    ring.last = ring.tail;
+    pthread_cond_signal(&ring.filled);
+    pthread_mutex_unlock(&ring.lock);
+    return NULL;
+}
+
+// decodes block k of a binary trace into batch, returning its length
+static int
+block_decode(int64_t k, access_t* batch)
+{
+    const uint8_t*  entry = blocks + 8 + k * TRACEFMT_ENTRY;
+    const uint8_t*  p;
+    const uint8_t*  end;
+    uint64_t        prev[4] = { 0, 0, 0, 0 };
+    uint64_t        v;
+    uint64_t        off;
+    uint32_t        len;
+    int             n;
+    int             op;
+
+    off = tracefmt_get(entry, 8);
+    len = (uint32_t)tracefmt_get(entry + 8, 4);
+    n = (int)tracefmt_get(entry + 12, 4);
+    if(off > map_len || len > map_len - off || n > TRACE_BATCH) exit(FAIL);
+    p = (const uint8_t*)map + off;
+    end = p + len;
+
+    for(int i=0; i<n; i++) {
+        if(p == end) exit(FAIL);
+        op = *p & 3;
+        v = *p++ >> 2;
+        if(v == TRACEFMT_BIGSIZE && !(p = varint_get(p, end, &v))) exit(FAIL);
+        batch[i].op = tracefmt_ops[op];
+        batch[i].size = (uint32_t)v;
+        if(!(p = varint_get(p, end, &v))) exit(FAIL);
+        prev[op] += (uint64_t)unzigzag(v);
+        batch[i].addr = prev[op];
+    }
+    return n;
+}
+
+static void*
+decoder_main(void* arg)
+{
+    int64_t     k;
+    int         n;
+
+    (void)arg;
+    while(1) {
+        pthread_mutex_lock(&ring.lock);
+        if(ring.tail == nblocks) {
+            pthread_mutex_unlock(&ring.lock);
+            break;
+        }
+        k = ring.tail++;
+        ring_wait(k);
+        pthread_mutex_unlock(&ring.lock);
+
+        n = block_decode(k, ring.batch[k % ring.slots]);
+
+        pthread_mutex_lock(&ring.lock);
+        ring_put(k, n);
+        pthread_mutex_unlock(&ring.lock);
+    }
+    return NULL;
+}
+
+// checks the header and finds the index of a binary trace
+static bool
+binary_open()
+{
+    const uint8_t*  p = (const uint8_t*)map;
+    uint64_t        off;
+
+    if(map_len < TRACEFMT_HEADER || memcmp(p, TRACEFMT_MAGIC, 4)) return false;
+    if(tracefmt_get(p + 4, 4) != TRACEFMT_VERSION) exit(FAIL);
+    off = tracefmt_get(p + 8, 8);
+    if(off > map_len - 8) exit(FAIL);
+    blocks = p + off;
+    nblocks = (int64_t)tracefmt_get(blocks, 8);
+    if(nblocks < 0 || (uint64_t)nblocks > (map_len - off - 8) / TRACEFMT_ENTRY)
+        exit(FAIL);
+    return true;
+}
+
+// reads the rest of a pipe that starts like a binary trace into memory,
+// where it is decoded as if it were mapped
+static void
+pipe_load()
+{
+    size_t      cap = 2 * TRACE_BLOCK;
+    ssize_t     n;
+
+    map = (char*)malloc(cap);
+    if(!map) exit(FAIL);
+    memcpy(map, peek, peek_len);
+    map_len = peek_len;
+    peek_len = 0;
+    while((n = read(trace_fd, map + map_len, cap - map_len)) > 0) {
+        map_len += n;
+        if(map_len < cap) continue;
+        cap *= 2;
+        map = (char*)realloc(map, cap);
+        if(!map) exit(FAIL);
+    }
+    if(n < 0) exit(FAIL);
+    map_read = true;
+}
+
+int
+trace_open(const char* path, int threads)
+{
+    struct stat st;
+
+    if(!path || !strcmp(path, "-")) trace_fd = STDIN_FILENO;
+    else trace_fd = open(path, O_RDONLY);
+    if(trace_fd < 0) return FAIL;
+
+    // regular files are mapped; pipes and terminals are read in blocks
+    if(!fstat(trace_fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map_len = st.st_size;
+        map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, trace_fd, 0);
+        if(map == MAP_FAILED) map = NULL;
+        else madvise(map, map_len, MADV_SEQUENTIAL);
+    }
+
+    // a pipe is peeked at for the magic of a binary trace
+    peek_len = 0;
+    if(!map) {
+        ssize_t n;
+
+        while(peek_len < sizeof(peek)
+              && (n = read(trace_fd, peek + peek_len, sizeof(peek) - peek_len)) > 0)
+            peek_len += n;
+        if(peek_len == sizeof(peek) && !memcmp(peek, TRACEFMT_MAGIC, 4)) pipe_load();
+    }
+
+    nreaders = 1;
+    if(map && binary_open())
+        nreaders = threads < 1 ? 1 : threads > TRACE_DECODERS ? TRACE_DECODERS : threads;
+    // a pipe that starts with the magic is no text trace either
+    else if(map_read) return FAIL;
+
+    memset(&ring, 0, sizeof(ring));
+    ring.slots = TRACE_BATCHES * nreaders;
+    ring.last = blocks ? nblocks : INT64_MAX;
+    for(int i=0; i<ring.slots; i++) {
+        ring.batch[i] = (access_t*)malloc(sizeof(access_t) * TRACE_BATCH);
+        if(!ring.batch[i]) return FAIL;
+    }
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.filled, NULL);
+    pthread_cond_init(&ring.drained, NULL);
+    out = ring.batch[0];
+    out_n = 0;
+
+    for(int i=0; i<nreaders; i++) {
+        if(pthread_create(&reader[i], NULL, blocks ? decoder_main : reader_main, NULL))
+            return FAIL;
+    }
+    return SUCCESS;
+}
+
+int
+trace_read(access_t** batch)
+{
+    int     n;
+
+    pthread_mutex_lock(&ring.lock);
+    if(ring.held) {
+        ring.held = false;
+        ring.full[ring.head % ring.slots] = false;
+        ring.head++;
+        pthread_cond_broadcast(&ring.drained);
+    }
+    while(!ring.full[ring.head % ring.slots] && ring.head < ring.last)
+        pthread_cond_wait(&ring.filled, &ring.lock);
+    if(ring.head == ring.last) {
+        pthread_mutex_unlock(&ring.lock);
+        return 0;
+    }
+    ring.held = true;
+    *batch = ring.batch[ring.head % ring.slots];
+    n = ring.count[ring.head % ring.slots];
+    pthread_mutex_unlock(&ring.lock);
+    return n;
+}
+
+void
+trace_close()
+{
+    for(int i=0; i<nreaders; i++) pthread_join(reader[i], NULL);
+    if(map && map_read) free(map);
+    else if(map) munmap(map, map_len);
+    if(trace_fd != STDIN_FILENO) close(trace_fd);
+    map = NULL;
+    map_read = false;
+    blocks = NULL;
+    for(int i=0; i<ring.slots; i++) free(ring.batch[i]);
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.filled);
+    pthread_cond_destroy(&ring.drained);
+}
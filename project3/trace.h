@@ -0,0 +1,25 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// one decoded access of a valgrind trace line " L 7ff000398,8".
+typedef struct access_t {
+    uint64_t    addr;
+    uint32_t    size;
+    char        op;     // 'I', 'L', 'S' or 'M'
+} access_t;
+
+// opens path, or stdin for NULL or "-", and starts the reader thread.
+// a binary trace (tracefmt.h) is decoded by up to threads threads
+// instead; one on a pipe is read whole before decoding starts.
+int     trace_open(const char* path, int threads);
+
+// hands out the next batch of accesses and returns its length, 0 at the
+// end of the trace. the previous batch is given back to the reader.
+int     trace_read(access_t** batch);
+
+// stops the reader; another trace may be opened afterwards.
+void    trace_close();
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef TRACEFMT_H
+#define TRACEFMT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// binary trace format, little endian.
+//
+//  header  "VGTB", u32 version, u64 offset of the index
+//  blocks  up to TRACEFMT_BLOCK accesses each, decodable on their own
+//  index   u64 block count, then per block u64 offset, u32 length in
+//          bytes, u32 number of accesses
+//
+// an access is a tag byte, op in bits 0-1 (I, L, S, M) and size in bits
+// 2-7 with TRACEFMT_BIGSIZE meaning a varint size follows, and then the
+// zigzag varint of its address minus the address of the previous access
+// of the same op in the block (0 at the start of a block).
+
+#define TRACEFMT_MAGIC      "VGTB"
+#define TRACEFMT_VERSION    (1)
+#define TRACEFMT_HEADER     (16)
+#define TRACEFMT_BLOCK      (1 << 16)   // accesses per block, one batch
+#define TRACEFMT_BIGSIZE    (63)
+#define TRACEFMT_ENTRY      (16)        // bytes per index entry
+#define TRACEFMT_MAXACCESS  (1 + 2 * 10)
+
+static const char   tracefmt_ops[4] = { 'I', 'L', 'S', 'M' };
+
+static inline int
+tracefmt_opcode(char op)
+{
+    return op == 'I' ? 0 : op == 'L' ? 1 : op == 'S' ? 2 : 3;
+}
+
+static inline uint64_t
+tracefmt_get(const uint8_t* p, int n)
+{
+    uint64_t    v = 0;
+
+    for(int i=n-1; i>=0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static inline void
+tracefmt_put(uint8_t* p, uint64_t v, int n)
+{
+    for(int i=0; i<n; i++, v>>=8) p[i] = (uint8_t)v;
+}
+
+static inline uint8_t*
+varint_put(uint8_t* p, uint64_t v)
+{
+    while(v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// returns NULL if the varint runs past end
+static inline const uint8_t*
+varint_get(const uint8_t* p, const uint8_t* end, uint64_t* v)
+{
+    uint64_t    x = 0;
+
+    for(int shift=0; p<end && shift<64; shift+=7) {
+        x |= (uint64_t)(*p & 0x7f) << shift;
+        if(!(*p++ & 0x80)) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline uint64_t
+zigzag(int64_t v)
+{
+    return (uint64_t)v << 1 ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t
+unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+#endif